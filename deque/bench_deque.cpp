@@ -0,0 +1,542 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <numeric>
+#include <deque>
+#include <cstring>
+#include <set>
+
+#include "deque.h"
+#include "buffer_pool.h"
+#include "work_stealing_deque.h"
+#include "monotonic_queue.h"
+
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+
+// Every heap allocation in this binary goes through here, the array and
+// sized forms included. operator delete stays out of line: inlined, gcc
+// would see free() taking a pointer from operator new and warn
+// (-Wmismatched-new-delete).
+static std::atomic<size_t> newCalls(0);
+
+void* operator new(size_t bytes) {
+    newCalls.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(bytes))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void* operator new[](size_t bytes) {
+    return operator new(bytes);
+}
+
+void operator delete[](void *ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+
+// The baseline we want to get rid of: Deque behind a mutex.
+class LockedQueue {
+private:
+    std::mutex mutex_;
+    Deque<int> deque_;
+
+public:
+    void push_back(int val) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        deque_.push_back(val);
+    }
+
+    bool pop_back(int &out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (deque_.empty()) return false;
+        out = deque_.back();
+        deque_.pop_back();
+        return true;
+    }
+
+    bool steal(int &out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (deque_.empty()) return false;
+        out = deque_.front();
+        deque_.pop_front();
+        return true;
+    }
+};
+
+
+// Fork-join scheduler workload: a task of depth d spawns two tasks of
+// depth d - 1, so a single root task unfolds into 2^(depth + 1) - 1 tasks.
+// Every worker owns one queue and steals from random victims when it runs dry.
+template <typename QueueT>
+double runScheduler(int threadsCnt, int depth) {
+    std::vector<std::unique_ptr<QueueT>> queues;
+    for (int i = 0; i < threadsCnt; i++)
+        queues.emplace_back(new QueueT());
+
+    const long long total = (2LL << depth) - 1;
+    std::atomic<long long> done(0);
+    queues[0]->push_back(depth);
+
+    auto worker = [&](int self) {
+        std::minstd_rand rng(self);
+        long long localDone = 0;
+        int task;
+        while (done.load(std::memory_order_relaxed) < total) {
+            bool got = queues[self]->pop_back(task);
+            if (!got && threadsCnt > 1)
+                got = queues[rng() % threadsCnt]->steal(task);
+            if (!got) {
+                if (localDone > 0) {
+                    done.fetch_add(localDone);
+                    localDone = 0;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (task > 0) {
+                queues[self]->push_back(task - 1);
+                queues[self]->push_back(task - 1);
+            }
+            if (++localDone == 1024) {
+                done.fetch_add(localDone);
+                localDone = 0;
+            }
+        }
+    };
+
+    auto start = steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadsCnt; i++)
+        threads.emplace_back(worker, i);
+    for (std::thread &thread : threads)
+        thread.join();
+    double seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+
+    return total / seconds / 1e6;
+}
+
+
+void benchStealing(int depth, int maxThreads) {
+    std::cout << "work stealing, 2^" << depth + 1 << " tasks, Mtasks/s" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "locked" << std::setw(12) << "chase-lev" << std::endl;
+    for (int threads = 1; threads <= maxThreads; threads *= 2) {
+        std::cout << std::setw(8) << threads << std::fixed << std::setprecision(2)
+                  << std::setw(12) << runScheduler<LockedQueue>(threads, depth)
+                  << std::setw(12) << runScheduler<WorkStealingDeque<int>>(threads, depth)
+                  << std::endl;
+    }
+}
+
+
+struct AllocStats {
+    double newPerCycle;
+    double nsPerOp;
+};
+
+// Queue that swings between low and high watermarks: fill up from the
+// back, drain from the front. The first cycles warm up pools and capacities,
+// only the following ones are counted.
+template <typename DequeT>
+AllocStats runOscillating(size_t low, size_t high, int cycles) {
+    const int warmup = 3;
+    DequeT d;
+    size_t ops = 0;
+    size_t newBefore = 0;
+    steady_clock::time_point start;
+
+    for (int cycle = 0; cycle < warmup + cycles; cycle++) {
+        if (cycle == warmup) {
+            newBefore = newCalls.load();
+            start = steady_clock::now();
+            ops = 0;
+        }
+        while (d.size() < high) {
+            d.push_back(static_cast<int>(ops));
+            ops++;
+        }
+        while (d.size() > low) {
+            d.pop_front();
+            ops++;
+        }
+    }
+
+    double seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+    AllocStats stats = {static_cast<double>(newCalls.load() - newBefore) / cycles, seconds * 1e9 / ops};
+    return stats;
+}
+
+template <typename DequeT>
+void printOscillating(const std::string &name, size_t low, size_t high, int cycles) {
+    AllocStats stats = runOscillating<DequeT>(low, high, cycles);
+    std::cout << std::setw(36) << name << std::fixed << std::setprecision(2)
+              << std::setw(14) << stats.newPerCycle << std::setw(10) << stats.nsPerOp << std::endl;
+}
+
+void benchAllocations(size_t low, size_t high, int cycles) {
+    typedef SplitVectorLayout<ShrinkToFit> Eager;
+    typedef SplitVectorLayout<ShrinkHysteresis<8, 2>> Lazy;
+
+    std::cout << "oscillating queue " << low << " <-> " << high << ", " << cycles << " cycles" << std::endl;
+    std::cout << std::setw(36) << "deque" << std::setw(14) << "new/cycle" << std::setw(10) << "ns/op" << std::endl;
+    printOscillating<Deque<int, Eager>>("split, shrink-to-fit (before)", low, high, cycles);
+    printOscillating<Deque<int, Lazy>>("split, hysteresis", low, high, cycles);
+    printOscillating<Deque<int, Eager, PoolAllocator<int>>>("split, shrink-to-fit, pool", low, high, cycles);
+    printOscillating<Deque<int, Lazy, PoolAllocator<int>>>("split, hysteresis, pool (after)", low, high, cycles);
+    printOscillating<Deque<int, DeamortizedSplitLayout>>("deamortized", low, high, cycles);
+    printOscillating<Deque<int, DeamortizedSplitLayout, PoolAllocator<int>>>("deamortized, pool", low, high, cycles);
+    printOscillating<Deque<int, BlockMapLayout<>>>("block map", low, high, cycles);
+    printOscillating<Deque<int, BlockMapLayout<>, PoolAllocator<int>>>("block map, pool", low, high, cycles);
+}
+
+
+template <typename Container>
+void fill(Container &c, const std::vector<int> &data) {
+    for (size_t i = 0; i < data.size(); i++) {
+        if (i % 2) c.push_back(data[i]);
+        else       c.push_front(data[i]);
+    }
+}
+
+template <>
+void fill(std::vector<int> &c, const std::vector<int> &data) {
+    c.assign(data.begin(), data.end());
+}
+
+template <typename Func>
+double timeMs(Func func) {
+    auto start = steady_clock::now();
+    func();
+    return duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count();
+}
+
+// Keeps the compiler from throwing a computed result away.
+static volatile long long sink;
+
+template <typename Container>
+void benchAlgoColumn(const std::string &name, const std::vector<int> &data, bool indexLoop) {
+    std::vector<int> out(data.size());
+    Container c;
+    fill(c, data);
+
+    std::cout << std::setw(16) << name << std::fixed << std::setprecision(1);
+    std::cout << std::setw(12) << timeMs([&]() {sink = std::accumulate(c.begin(), c.end(), 0LL);});
+    std::cout << std::setw(12) << timeMs([&]() {std::copy(c.begin(), c.end(), out.begin());});
+    if (indexLoop) {
+        std::cout << std::setw(12) << timeMs([&]() {
+            long long sum = 0;
+            for (size_t i = 0; i < c.size(); i++) sum += c[i];
+            sink = sum;
+        });
+    } else {
+        std::cout << std::setw(12) << "-";
+    }
+    std::cout << std::setw(12) << timeMs([&]() {std::sort(c.begin(), c.end());}) << std::endl;
+}
+
+// Deque only: the same accumulate/copy over segments().
+template <typename DequeT>
+void benchSegmentsColumn(const std::string &name, const std::vector<int> &data) {
+    std::vector<int> out(data.size());
+    DequeT d;
+    fill(d, data);
+
+    std::cout << std::setw(16) << name << std::fixed << std::setprecision(1);
+    std::cout << std::setw(12) << timeMs([&]() {
+        long long sum = 0;
+        for (const DequeSegment<const int> &seg : static_cast<const DequeT&>(d).segments())
+            sum = std::accumulate(seg.data(), seg.data() + seg.size(), sum);
+        sink = sum;
+    });
+    std::cout << std::setw(12) << timeMs([&]() {
+        for (const DequeSegment<const int> &seg : static_cast<const DequeT&>(d).segments()) {
+            if (seg.reversed())
+                std::reverse_copy(seg.data(), seg.data() + seg.size(), out.begin() + seg.begin);
+            else
+                std::memcpy(&out[seg.begin], seg.data(), seg.size() * sizeof(int));
+        }
+    });
+    std::cout << std::setw(12) << "-" << std::setw(12) << "-" << std::endl;
+}
+
+void benchAlgorithms(size_t count) {
+    std::vector<int> data(count);
+    std::minstd_rand rng(1);
+    for (int &x : data)
+        x = static_cast<int>(rng());
+
+    std::cout << "std algorithms over " << count << " ints, ms" << std::endl;
+    std::cout << std::setw(16) << "container" << std::setw(12) << "accumulate" << std::setw(12) << "copy"
+              << std::setw(12) << "index loop" << std::setw(12) << "sort" << std::endl;
+    benchAlgoColumn<std::vector<int>>("std::vector", data, true);
+    benchAlgoColumn<std::deque<int>>("std::deque", data, true);
+    benchAlgoColumn<Deque<int>>("split", data, true);
+    benchAlgoColumn<Deque<int, DeamortizedSplitLayout>>("deamortized", data, true);
+    benchAlgoColumn<Deque<int, BlockMapLayout<>>>("block map", data, true);
+    benchSegmentsColumn<Deque<int>>("split segs", data);
+    benchSegmentsColumn<Deque<int, DeamortizedSplitLayout>>("deamort. segs", data);
+    benchSegmentsColumn<Deque<int, BlockMapLayout<>>>("block map segs", data);
+}
+
+
+struct Record {
+    long long id;
+    double value;
+    char tag[16];
+
+    Record(): id(0), value(0), tag() {}
+    Record(long long id, double value): id(id), value(value), tag() {}
+};
+
+template <typename DequeT>
+void benchBulkRow(const std::string &name, const std::vector<Record> &batch) {
+    const size_t kPopBatch = 4096;
+    std::vector<Record> out(batch.size());
+
+    std::cout << std::setw(16) << name << std::fixed << std::setprecision(1);
+    {
+        DequeT d;
+        std::cout << std::setw(12) << timeMs([&]() {
+            for (const Record &rec : batch)
+                d.push_back(rec);
+        });
+    }
+    {
+        DequeT d;
+        std::cout << std::setw(12) << timeMs([&]() {
+            for (size_t i = 0; i < batch.size(); i++)
+                d.emplace_back(static_cast<long long>(i), 0.5);
+        });
+    }
+    DequeT d;
+    std::cout << std::setw(12) << timeMs([&]() {d.append(batch.begin(), batch.end());});
+
+    DequeT copy(d);
+    std::cout << std::setw(12) << timeMs([&]() {
+        for (size_t i = 0; !copy.empty(); i++) {
+            out[i] = std::move(copy.front());
+            copy.pop_front();
+        }
+    });
+    std::cout << std::setw(12) << timeMs([&]() {
+        for (size_t done = 0; !d.empty(); )
+            done += d.pop_front_n(out.data() + done, kPopBatch);
+    }) << std::endl;
+}
+
+void benchBulk(size_t count) {
+    std::vector<Record> batch;
+    for (size_t i = 0; i < count; i++)
+        batch.emplace_back(static_cast<long long>(i), 0.5);
+
+    std::cout << "bulk load/drain of " << count << " " << sizeof(Record) << "-byte records, ms" << std::endl;
+    std::cout << std::setw(16) << "deque" << std::setw(12) << "push loop" << std::setw(12) << "emplace"
+              << std::setw(12) << "append" << std::setw(12) << "pop loop" << std::setw(12) << "pop_front_n" << std::endl;
+    benchBulkRow<Deque<Record>>("split", batch);
+    benchBulkRow<Deque<Record, DeamortizedSplitLayout>>("deamortized", batch);
+    benchBulkRow<Deque<Record, BlockMapLayout<>>>("block map", batch);
+}
+
+
+// Bounded queue in steady state: keep `window` elements, push at one end
+// and pop at the other (FIFO), or push and pop at random ends.
+template <typename DequeT>
+void benchRingRow(const std::string &name, DequeT &d, size_t window, size_t ops) {
+    std::minstd_rand rng(1);
+    std::vector<bool> sides(ops);
+    for (size_t i = 0; i < ops; i++)
+        sides[i] = rng() % 2;
+
+    while (d.size() < window)
+        d.push_back(0);
+
+    std::cout << std::setw(20) << name << std::fixed << std::setprecision(2);
+    size_t newBefore = newCalls.load();
+    double fifo = timeMs([&]() {
+        for (size_t i = 0; i < ops; i++) {
+            d.push_back(static_cast<int>(i));
+            d.pop_front();
+        }
+    });
+    double random = timeMs([&]() {
+        for (size_t i = 0; i < ops; i++) {
+            if (sides[i]) d.push_back(static_cast<int>(i));
+            else          d.push_front(static_cast<int>(i));
+            if (sides[ops - 1 - i]) d.pop_back();
+            else                    d.pop_front();
+        }
+    });
+    double index = timeMs([&]() {
+        long long sum = 0;
+        for (size_t i = 0; i < ops; i++)
+            sum += d[i & (window - 1)];
+        sink = sum;
+    });
+    std::cout << std::setw(12) << fifo * 1e6 / ops << std::setw(12) << random * 1e6 / ops
+              << std::setw(12) << index * 1e6 / ops << std::setw(12) << newCalls.load() - newBefore << std::endl;
+}
+
+void benchRing(size_t ops) {
+    const size_t kWindow = 1 << 12;
+    // room for the random walk around the window
+    typedef RingBufferLayout<2 * kWindow> Fixed;
+    typedef RingBufferLayout<> Sized;
+
+    std::cout << "bounded queue of " << kWindow << " ints, " << ops << " ops, ns/op" << std::endl;
+    std::cout << std::setw(20) << "deque" << std::setw(12) << "fifo" << std::setw(12) << "random ends"
+              << std::setw(12) << "index" << std::setw(12) << "new calls" << std::endl;
+    {
+        Deque<int> d;
+        benchRingRow("split", d, kWindow, ops);
+    }
+    {
+        Deque<int, BlockMapLayout<>> d;
+        benchRingRow("block map", d, kWindow, ops);
+    }
+    {
+        std::unique_ptr<Deque<int, Fixed>> d(new Deque<int, Fixed>());
+        benchRingRow("ring, compile-time", *d, kWindow, ops);
+    }
+    {
+        Deque<int, Sized> d((Sized(2 * kWindow)));
+        benchRingRow("ring, run-time", d, kWindow, ops);
+    }
+}
+
+
+// Two halves of count elements in total are joined, then split in the
+// middle and joined back. Baseline: moving the elements with push/pop.
+template <typename DequeT>
+void benchSpliceRow(const std::string &name, size_t count) {
+    DequeT a, b;
+    for (size_t i = 0; i < count / 2; i++) {
+        a.push_back(static_cast<int>(i));
+        b.push_back(static_cast<int>(i));
+    }
+    DequeT c(a), d(b);
+
+    std::cout << std::setw(16) << name << std::fixed << std::setprecision(3);
+    std::cout << std::setw(14) << timeMs([&]() {
+        for (; !d.empty(); d.pop_front())
+            c.push_back(d.front());
+    });
+    std::cout << std::setw(14) << timeMs([&]() {a.splice_back(std::move(b));});
+    DequeT tail;
+    std::cout << std::setw(14) << timeMs([&]() {tail = a.split_at(a.size() / 2);});
+    std::cout << std::setw(14) << timeMs([&]() {a.splice_back(std::move(tail));});
+    std::cout << std::setw(14) << timeMs([&]() {tail = a.split_at(a.size() / 3);});
+    std::cout << std::setw(14) << timeMs([&]() {a.splice_front(std::move(tail));}) << std::endl;
+    sink = a[a.size() / 2] + c.back();
+}
+
+void benchSplice(size_t count) {
+    std::cout << "join/split of " << count << " ints, ms" << std::endl;
+    std::cout << std::setw(16) << "deque" << std::setw(14) << "push loop" << std::setw(14) << "splice"
+              << std::setw(14) << "split 1/2" << std::setw(14) << "rejoin" << std::setw(14) << "split 1/3"
+              << std::setw(14) << "splice front" << std::endl;
+    benchSpliceRow<Deque<int>>("split", count);
+    benchSpliceRow<Deque<int, DeamortizedSplitLayout>>("deamortized", count);
+    benchSpliceRow<Deque<int, BlockMapLayout<>>>("block map", count);
+}
+
+
+// Rolling minimum and maximum over every window of the input.
+void benchWindow(size_t count) {
+    std::vector<int> data(count);
+    std::minstd_rand rng(1);
+    for (int &x : data)
+        x = static_cast<int>(rng() % 1000000);
+
+    std::cout << "rolling min/max over " << count << " ints, ms" << std::endl;
+    std::cout << std::setw(10) << "window" << std::setw(12) << "multiset" << std::setw(12) << "monotonic"
+              << std::setw(14) << "windowMinima" << std::endl;
+    for (size_t width : {16, 1024, 65536}) {
+        std::vector<int> mins(count), maxs(count);
+        std::cout << std::setw(10) << width << std::fixed << std::setprecision(1);
+        std::cout << std::setw(12) << timeMs([&]() {
+            std::multiset<int> window;
+            for (size_t i = 0; i < count; i++) {
+                window.insert(data[i]);
+                if (i >= width)
+                    window.erase(window.find(data[i - width]));
+                mins[i] = *window.begin();
+                maxs[i] = *window.rbegin();
+            }
+        });
+        std::cout << std::setw(12) << timeMs([&]() {
+            MonotonicQueue<int> window;
+            for (size_t i = 0; i < count; i++) {
+                window.push(data[i]);
+                if (i >= width)
+                    window.pop();
+                mins[i] = window.min();
+                maxs[i] = window.max();
+            }
+        });
+        std::cout << std::setw(14) << timeMs([&]() {
+            windowMinima(data.begin(), data.end(), width, mins.begin());
+            windowMinima(data.begin(), data.end(), width, maxs.begin(), std::greater<int>());
+        }) << std::endl;
+        sink = mins[count / 2] + maxs[count / 2];
+    }
+}
+
+
+// usage: bench_deque [stealing|alloc|algo|bulk|ring|splice|window]...
+int main(int argc, char **argv) {
+    std::vector<std::string> benches(argv + 1, argv + argc);
+    if (benches.empty())
+        benches = {"stealing", "alloc", "algo", "bulk", "ring", "splice", "window"};
+
+    for (const std::string &bench : benches) {
+        if (bench == "stealing") {
+            benchStealing(22, std::max(1, 2 * static_cast<int>(std::thread::hardware_concurrency())));
+        } else if (bench == "alloc") {
+            benchAllocations(1000, 3000, 1000);
+            std::cout << std::endl;
+            benchAllocations(1000, 100000, 50);
+        } else if (bench == "algo") {
+            benchAlgorithms(10000000);
+        } else if (bench == "bulk") {
+            benchBulk(5000000);
+        } else if (bench == "ring") {
+            benchRing(20000000);
+        } else if (bench == "splice") {
+            for (size_t count = 1000000; count <= 100000000; count *= 10)
+                benchSplice(count);
+        } else if (bench == "window") {
+            benchWindow(10000000);
+        } else {
+            std::cerr << "unknown benchmark: " << bench << std::endl;
+            return 1;
+        }
+        std::cout << std::endl;
+    }
+}
@@ -0,0 +1,365 @@
+#pragma once
+#ifndef BLOCK_MAP_STORAGE_H_INCLUDED
+#define BLOCK_MAP_STORAGE_H_INCLUDED
+
+#include <cassert>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+#include "deque_segment.h"
+
+
+// Fixed-size chunks behind a circular map of chunk pointers.
+//
+// Element i lives at absolute position first_ + i; the upper bits of a
+// position select the chunk, the lower bits - the slot inside it.
+// Positions start in the middle of the size_t range, so they never wrap,
+// and the map is circular (its capacity is a power of two).
+//
+// Elements never move, so references stay valid across pushes.
+// The map itself is grown incrementally: once it is half full a map of
+// twice the capacity is allocated and every following push/pop copies
+// a couple of chunk pointers into it, so no operation is O(n).
+template <size_t ChunkBytes> struct BlockMapLayout;
+
+template <typename T, typename Allocator, size_t ChunkBytes>
+class BlockMapStorage {
+private:
+    static constexpr size_t floorPow2(size_t x, size_t p = 1) {
+        return (p * 2 > x ? p : floorPow2(x, p * 2));
+    }
+
+    static constexpr size_t log2(size_t x) {
+        return (x <= 1 ? 0 : 1 + log2(x / 2));
+    }
+
+public:
+    static constexpr size_t kChunkSize  = floorPow2(ChunkBytes / sizeof(T) > 0 ? ChunkBytes / sizeof(T) : 1);
+
+private:
+    static constexpr size_t kChunkShift = log2(kChunkSize);
+    static constexpr size_t kChunkMask  = kChunkSize - 1;
+    static constexpr size_t kMinMap     = 8;
+    static constexpr size_t kMigrationStep = 4;
+    static constexpr size_t kMiddle = ~static_cast<size_t>(0) / 2 + 1;
+
+    typedef std::allocator_traits<Allocator> Traits;
+    typedef typename Traits::template rebind_alloc<T*> MapAllocator;
+
+    struct Map {
+        T **slots;
+        size_t capacity; // power of two
+
+        T*& at(size_t chunk) const {return slots[chunk & (capacity - 1)];}
+    };
+
+    Allocator alloc_;
+    MapAllocator mapAlloc_;
+
+    Map map_;
+    Map newMap_;        // slots == nullptr when no migration is in progress
+    size_t migrated_;   // next chunk number to copy into newMap_
+
+    size_t first_;      // absolute position of the front element
+    size_t size_;
+    T *spare_;          // last released chunk, reused to avoid malloc ping-pong
+
+    Map allocMap(size_t capacity) {
+        Map map = {mapAlloc_.allocate(capacity), capacity};
+        std::fill(map.slots, map.slots + capacity, nullptr);
+        return map;
+    }
+
+    void freeMap(Map &map) {
+        if (map.slots != nullptr)
+            mapAlloc_.deallocate(map.slots, map.capacity);
+        map.slots = nullptr;
+    }
+
+    size_t firstChunk() const {return first_ >> kChunkShift;}
+    size_t lastChunk()  const {return (first_ + size_ - 1) >> kChunkShift;}
+    size_t chunkCount() const {return (size_ == 0 ? 0 : lastChunk() - firstChunk() + 1);}
+
+    T* slot(size_t pos) const {
+        return map_.at(pos >> kChunkShift) + (pos & kChunkMask);
+    }
+
+    void setChunk(size_t chunk, T *ptr) {
+        map_.at(chunk) = ptr;
+        if (newMap_.slots != nullptr)
+            newMap_.at(chunk) = ptr;
+    }
+
+    void placeChunk(size_t chunk, T *ptr) {
+        if (chunkCount() + 1 > map_.capacity / 2 && newMap_.slots == nullptr) {
+            newMap_ = allocMap(map_.capacity * 2);
+            migrated_ = firstChunk();
+        }
+        assert(chunkCount() < map_.capacity);
+        setChunk(chunk, ptr);
+    }
+
+    void acquireChunk(size_t chunk) {
+        T *ptr = spare_;
+        spare_ = nullptr;
+        placeChunk(chunk, (ptr != nullptr ? ptr : alloc_.allocate(kChunkSize)));
+    }
+
+    // Appends the elements of other whose front has the same offset in its
+    // chunk as our end: after topping up our last chunk, the rest of other's
+    // chunks are taken over by pointer. One migration step per chunk keeps
+    // the map growing fast enough, as in append.
+    void spliceChunks(BlockMapStorage &other) {
+        while (!other.empty() && ((first_ + size_) & kChunkMask) != 0) {
+            emplace_back(std::move(*other.slot(other.first_)));
+            other.pop_front();
+        }
+        while (!other.empty()) {
+            const size_t count = (other.size_ < kChunkSize ? other.size_ : kChunkSize);
+            placeChunk((first_ + size_) >> kChunkShift, other.map_.at(other.firstChunk()));
+            other.setChunk(other.firstChunk(), nullptr);
+            size_ += count;
+            other.first_ += count;
+            other.size_ -= count;
+            stepMigration();
+            other.stepMigration();
+        }
+    }
+
+    void releaseChunk(size_t chunk) {
+        T *ptr = map_.at(chunk);
+        setChunk(chunk, nullptr);
+        if (spare_ == nullptr)
+            spare_ = ptr;
+        else
+            alloc_.deallocate(ptr, kChunkSize);
+    }
+
+    void stepMigration() {
+        if (newMap_.slots == nullptr) return;
+
+        // chunks written after the migration started are already in both maps
+        size_t end = firstChunk() + chunkCount();
+        migrated_ = std::max(migrated_, firstChunk());
+        for (size_t i = 0; i < kMigrationStep && migrated_ < end; i++, migrated_++)
+            newMap_.at(migrated_) = map_.at(migrated_);
+
+        if (migrated_ >= end) {
+            freeMap(map_);
+            map_ = newMap_;
+            newMap_.slots = nullptr;
+        }
+    }
+
+public:
+    BlockMapStorage(const BlockMapLayout<ChunkBytes>&, const Allocator &alloc):
+        alloc_(alloc), mapAlloc_(alloc), map_(allocMap(kMinMap)), newMap_(), migrated_(0),
+        first_(kMiddle + kChunkSize / 2), size_(0), spare_(nullptr) {}
+
+    BlockMapStorage(const BlockMapStorage &other):
+        BlockMapStorage(BlockMapLayout<ChunkBytes>(), Traits::select_on_container_copy_construction(other.alloc_)) {
+        for (size_t i = 0; i < other.size(); i++)
+            emplace_back(other[i]);
+    }
+
+    BlockMapStorage(BlockMapStorage &&other): BlockMapStorage(BlockMapLayout<ChunkBytes>(), other.alloc_) {
+        swap(other);
+    }
+
+    BlockMapStorage& operator=(BlockMapStorage other) {
+        swap(other);
+        return *this;
+    }
+
+    ~BlockMapStorage() {
+        while (!empty())
+            pop_back();
+        freeMap(map_);
+        freeMap(newMap_);
+        if (spare_ != nullptr)
+            alloc_.deallocate(spare_, kChunkSize);
+    }
+
+    void swap(BlockMapStorage &other) {
+        std::swap(alloc_, other.alloc_);
+        std::swap(mapAlloc_, other.mapAlloc_);
+        std::swap(map_, other.map_);
+        std::swap(newMap_, other.newMap_);
+        std::swap(migrated_, other.migrated_);
+        std::swap(first_, other.first_);
+        std::swap(size_, other.size_);
+        std::swap(spare_, other.spare_);
+    }
+
+    const T& front() const {assert(size_ > 0); return *slot(first_);}
+    const T& back()  const {assert(size_ > 0); return *slot(first_ + size_ - 1);}
+    const T& operator[](size_t i) const {return *slot(first_ + i);}
+
+    bool empty() const {return size_ == 0;}
+    size_t size() const {return size_;}
+
+    // the chunk holding element i
+    DequeSegment<const T> segment(size_t i) const {
+        size_t offset = (first_ + i) & kChunkMask;
+        size_t begin = i - std::min(offset, i);
+        size_t end = std::min(size_, i - offset + kChunkSize);
+        DequeSegment<const T> seg = {slot(first_ + begin), 1, begin, end};
+        return seg;
+    }
+
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        size_t pos = first_ + size_;
+        if (size_ == 0 || (pos & kChunkMask) == 0)
+            acquireChunk(pos >> kChunkShift);
+        Traits::construct(alloc_, slot(pos), std::forward<Args>(args)...);
+        size_++;
+        stepMigration();
+    }
+
+    template <typename... Args>
+    void emplace_front(Args&&... args) {
+        size_t pos = first_ - 1;
+        if (size_ == 0 || (pos & kChunkMask) == kChunkMask)
+            acquireChunk(pos >> kChunkShift);
+        Traits::construct(alloc_, slot(pos), std::forward<Args>(args)...);
+        first_ = pos;
+        size_++;
+        stepMigration();
+    }
+
+    // Fills a chunk at a time. One migration step per chunk is enough to
+    // finish growing the map before it runs out.
+    template <typename BidirIt>
+    void append(BidirIt first, BidirIt last) {
+        while (first != last) {
+            size_t pos = first_ + size_;
+            if (size_ == 0 || (pos & kChunkMask) == 0)
+                acquireChunk(pos >> kChunkShift);
+            T *dst = slot(pos);
+            for (size_t room = kChunkSize - (pos & kChunkMask); room > 0 && first != last; room--) {
+                Traits::construct(alloc_, dst++, *first++);
+                size_++;
+            }
+            stepMigration();
+        }
+    }
+
+    template <typename BidirIt>
+    void prepend(BidirIt first, BidirIt last) {
+        while (first != last) {
+            size_t pos = first_ - 1;
+            if (size_ == 0 || (pos & kChunkMask) == kChunkMask)
+                acquireChunk(pos >> kChunkShift);
+            T *dst = slot(pos);
+            for (size_t room = (pos & kChunkMask) + 1; room > 0 && first != last; room--) {
+                Traits::construct(alloc_, dst--, *--last);
+                first_--;
+                size_++;
+            }
+            stepMigration();
+        }
+    }
+
+    void pop_back() {
+        assert(size_ > 0);
+        size_t pos = first_ + size_ - 1;
+        Traits::destroy(alloc_, slot(pos));
+        size_--;
+        if (size_ == 0 || (pos & kChunkMask) == 0)
+            releaseChunk(pos >> kChunkShift);
+        stepMigration();
+    }
+
+    void pop_front() {
+        assert(size_ > 0);
+        size_t pos = first_;
+        Traits::destroy(alloc_, slot(pos));
+        first_++;
+        size_--;
+        if (size_ == 0 || (pos & kChunkMask) == kChunkMask)
+            releaseChunk(pos >> kChunkShift);
+        stepMigration();
+    }
+
+    void erase_back(size_t count) {
+        assert(count <= size_);
+        while (count-- > 0)
+            pop_back();
+    }
+
+    void erase_front(size_t count) {
+        assert(count <= size_);
+        while (count-- > 0)
+            pop_front();
+    }
+
+    // O(other.size() / kChunkSize + kChunkSize) if other's front sits at the
+    // offset in its chunk where our back ends, otherwise the smaller side is
+    // moved element by element. Both sides must use equal allocators.
+    void splice_back(BlockMapStorage &other) {
+        if (empty()) {
+            swap(other);
+        } else if (((first_ + size_) & kChunkMask) == (other.first_ & kChunkMask)) {
+            spliceChunks(other);
+        } else if (other.size_ <= size_) {
+            for (; !other.empty(); other.pop_front())
+                emplace_back(std::move(*other.slot(other.first_)));
+        } else {
+            for (; !empty(); pop_back())
+                other.emplace_front(std::move(*slot(first_ + size_ - 1)));
+            swap(other);
+        }
+    }
+
+    void splice_front(BlockMapStorage &other) {
+        other.splice_back(*this);
+        swap(other);
+    }
+
+    // Returns [i, size()), keeping [0, i). The new storage puts element i at
+    // the same offset in its chunk, so only the rest of that chunk is moved
+    // and the following chunks are handed over by pointer.
+    BlockMapStorage split(size_t i) {
+        assert(i <= size_);
+        BlockMapStorage tail(BlockMapLayout<ChunkBytes>(), alloc_);
+        if (i == 0) {
+            swap(tail);
+            return tail;
+        }
+
+        const size_t pos = first_ + i;
+        const size_t end = first_ + size_;
+        const size_t boundary = std::min(end, ((pos >> kChunkShift) + 1) << kChunkShift);
+        tail.first_ = kMiddle + (pos & kChunkMask);
+        for (size_t p = pos; p < boundary; p++)
+            tail.emplace_back(std::move(*slot(p)));
+
+        for (size_t p = boundary; p < end; ) {
+            const size_t count = (end - p < kChunkSize ? end - p : kChunkSize);
+            tail.placeChunk((tail.first_ + tail.size_) >> kChunkShift, map_.at(p >> kChunkShift));
+            setChunk(p >> kChunkShift, nullptr);
+            tail.size_ += count;
+            tail.stepMigration();
+            p += count;
+        }
+
+        for (size_t p = pos; p < boundary; p++)
+            Traits::destroy(alloc_, slot(p));
+        if ((pos & kChunkMask) == 0 && pos < end)
+            releaseChunk(pos >> kChunkShift);
+        size_ = i;
+        stepMigration();
+        return tail;
+    }
+};
+
+template <size_t ChunkBytes = 4096>
+struct BlockMapLayout {
+    template <typename T, typename Allocator>
+    using storage = BlockMapStorage<T, Allocator, ChunkBytes>;
+};
+
+#endif // #ifndef BLOCK_MAP_STORAGE_H_INCLUDED
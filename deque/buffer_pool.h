@@ -0,0 +1,123 @@
+#pragma once
+#ifndef BUFFER_POOL_H_INCLUDED
+#define BUFFER_POOL_H_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <mutex>
+#include <vector>
+#include <type_traits>
+
+
+// Keeps released buffers in free lists by size class (powers of two bytes)
+// and hands them out again instead of going back to the heap, so a
+// container that keeps growing and shrinking its buffers stops allocating
+// once every size it needs has been seen.
+class BufferPool {
+private:
+    static const size_t kMinClass = 4; // 16 bytes
+    static const size_t kClasses = 8 * sizeof(size_t);
+
+    mutable std::mutex mutex_;
+    std::vector<void*> freeLists_[kClasses];
+    size_t cachedBytes_;
+    size_t maxCachedBytes_;
+
+    static size_t sizeClass(size_t bytes) {
+        size_t cls = kMinClass;
+        while ((static_cast<size_t>(1) << cls) < bytes)
+            cls++;
+        return cls;
+    }
+
+public:
+    explicit BufferPool(size_t maxCachedBytes = SIZE_MAX):
+        mutex_(), freeLists_(), cachedBytes_(0), maxCachedBytes_(maxCachedBytes) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    ~BufferPool() {
+        for (std::vector<void*> &list : freeLists_)
+            for (void *ptr : list)
+                ::operator delete(ptr);
+    }
+
+    // Pool behind default-constructed PoolAllocators. Never destroyed, so
+    // containers with static storage duration can still release into it.
+    static BufferPool& shared() {
+        static BufferPool *pool = new BufferPool();
+        return *pool;
+    }
+
+    void* allocate(size_t bytes) {
+        size_t cls = sizeClass(bytes);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::vector<void*> &list = freeLists_[cls];
+            if (!list.empty()) {
+                void *ptr = list.back();
+                list.pop_back();
+                cachedBytes_ -= static_cast<size_t>(1) << cls;
+                return ptr;
+            }
+        }
+        return ::operator new(static_cast<size_t>(1) << cls);
+    }
+
+    void deallocate(void *ptr, size_t bytes) {
+        size_t cls = sizeClass(bytes);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (cachedBytes_ + (static_cast<size_t>(1) << cls) <= maxCachedBytes_) {
+                freeLists_[cls].push_back(ptr);
+                cachedBytes_ += static_cast<size_t>(1) << cls;
+                return;
+            }
+        }
+        ::operator delete(ptr);
+    }
+
+    size_t cachedBytes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return cachedBytes_;
+    }
+};
+
+
+// Standard allocator on top of a BufferPool.
+template <typename T>
+class PoolAllocator {
+private:
+    template <typename U> friend class PoolAllocator;
+
+    BufferPool *pool_;
+
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    PoolAllocator(): pool_(&BufferPool::shared()) {}
+    explicit PoolAllocator(BufferPool &pool): pool_(&pool) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &other): pool_(other.pool_) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(pool_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, size_t n) {
+        pool_->deallocate(ptr, n * sizeof(T));
+    }
+
+    template <typename U>
+    bool operator==(const PoolAllocator<U> &other) const {return pool_ == other.pool_;}
+
+    template <typename U>
+    bool operator!=(const PoolAllocator<U> &other) const {return pool_ != other.pool_;}
+};
+
+#endif // #ifndef BUFFER_POOL_H_INCLUDED
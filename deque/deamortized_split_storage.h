@@ -0,0 +1,337 @@
+#pragma once
+#ifndef DEAMORTIZED_SPLIT_STORAGE_H_INCLUDED
+#define DEAMORTIZED_SPLIT_STORAGE_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include "deque_segment.h"
+
+
+// Array that grows at its back and can be popped from both ends in
+// worst-case O(1).
+//
+// Elements occupy absolute positions [head_, tail_). Popping from the head
+// only moves head_, so no element is ever shifted. When the buffer gets
+// half full (or mostly empty) a new one of 4x the live size is allocated
+// and the live elements are moved into it a few per operation, while new
+// elements are pushed straight into the new buffer. Positions in
+// [migHead_, migTail_) are those still waiting in the old buffer.
+template <typename T, typename Allocator>
+class IncrementalArray {
+private:
+    typedef std::allocator_traits<Allocator> Traits;
+
+    static const size_t kMinCapacity = 16;
+    static const size_t kMigrationStep = 2;
+
+    struct Buffer {
+        T *data;
+        size_t base;     // position stored in data[0]
+        size_t capacity;
+
+        T* at(size_t pos) const {return data + (pos - base);}
+    };
+
+    Allocator alloc_;
+    Buffer cur_;
+    Buffer old_;         // data == nullptr when not migrating
+    size_t head_, tail_;
+    size_t migHead_, migTail_;
+    size_t moved_;       // elements migrated so far
+
+    bool inOld(size_t pos) const {return pos >= migHead_ && pos < migTail_;}
+    T* locate(size_t pos) const {return (inOld(pos) ? old_.at(pos) : cur_.at(pos));}
+
+    void startMigration(size_t capacity) {
+        old_ = cur_;
+        cur_.data = alloc_.allocate(capacity);
+        cur_.base = head_;
+        cur_.capacity = capacity;
+        migHead_ = head_;
+        migTail_ = tail_;
+    }
+
+    void release(Buffer &buf) {
+        if (buf.data != nullptr)
+            alloc_.deallocate(buf.data, buf.capacity);
+        buf.data = nullptr;
+    }
+
+    // Called after every modification: moves at most kMigrationStep elements.
+    // Keeps cur_ at most 3/4 full, so the next push always has room.
+    void step() {
+        if (old_.data == nullptr) {
+            if (head_ == tail_)
+                head_ = tail_ = cur_.base;
+
+            size_t used = tail_ - cur_.base;
+            size_t live = tail_ - head_;
+            if (used * 2 >= cur_.capacity || (cur_.capacity > kMinCapacity && live * 8 < cur_.capacity))
+                startMigration(live * 4 > kMinCapacity ? live * 4 : kMinCapacity);
+            else
+                return;
+        }
+
+        for (size_t i = 0; i < kMigrationStep && migHead_ < migTail_; i++, migHead_++) {
+            T *from = old_.at(migHead_);
+            Traits::construct(alloc_, cur_.at(migHead_), std::move(*from));
+            Traits::destroy(alloc_, from);
+            moved_++;
+        }
+
+        if (migHead_ >= migTail_) {
+            release(old_);
+            migHead_ = migTail_ = 0;
+        }
+    }
+
+public:
+    explicit IncrementalArray(const Allocator &alloc):
+        alloc_(alloc), cur_(), old_(), head_(0), tail_(0), migHead_(0), migTail_(0),
+        moved_(0) {}
+
+    IncrementalArray(const IncrementalArray &other):
+        IncrementalArray(Traits::select_on_container_copy_construction(other.alloc_)) {
+        for (size_t i = 0; i < other.size(); i++)
+            emplace_back(other[i]);
+    }
+
+    IncrementalArray(IncrementalArray &&other): IncrementalArray(other.alloc_) {
+        swap(other);
+    }
+
+    IncrementalArray& operator=(IncrementalArray other) {
+        swap(other);
+        return *this;
+    }
+
+    ~IncrementalArray() {
+        for (size_t pos = head_; pos != tail_; pos++)
+            Traits::destroy(alloc_, locate(pos));
+        release(cur_);
+        release(old_);
+    }
+
+    void swap(IncrementalArray &other) {
+        std::swap(alloc_, other.alloc_);
+        std::swap(cur_, other.cur_);
+        std::swap(old_, other.old_);
+        std::swap(head_, other.head_);
+        std::swap(tail_, other.tail_);
+        std::swap(migHead_, other.migHead_);
+        std::swap(migTail_, other.migTail_);
+        std::swap(moved_, other.moved_);
+    }
+
+    Allocator get_allocator() const {return alloc_;}
+
+    size_t size() const {return tail_ - head_;}
+    bool empty() const {return head_ == tail_;}
+
+    // at most kMigrationStep more after any single operation
+    size_t moved() const {return moved_;}
+
+    const T& operator[](size_t i) const {return *locate(head_ + i);}
+
+    // the run of elements around i that sits in a single buffer
+    DequeSegment<const T> segment(size_t i) const {
+        size_t pos = head_ + i;
+        size_t from, to;
+        if (inOld(pos)) {
+            from = std::max(migHead_, head_);
+            to = std::min(migTail_, tail_);
+        } else if (pos < migHead_) {
+            from = head_;
+            to = std::min(migHead_, tail_);
+        } else {
+            from = std::max(migTail_, head_);
+            to = tail_;
+        }
+        DequeSegment<const T> seg = {locate(from), 1, from - head_, to - head_};
+        return seg;
+    }
+
+    const T& front() const {assert(!empty()); return *locate(head_);}
+    const T& back()  const {assert(!empty()); return *locate(tail_ - 1);}
+
+    // args may refer to an element of this array, so nothing is migrated
+    // until the new element has been constructed
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        if (cur_.data == nullptr)
+            step();
+        assert(tail_ - cur_.base < cur_.capacity);
+        Traits::construct(alloc_, cur_.at(tail_), std::forward<Args>(args)...);
+        tail_++;
+        step();
+    }
+
+    void pop_back() {
+        assert(!empty());
+        tail_--;
+        Traits::destroy(alloc_, locate(tail_));
+        if (inOld(tail_))
+            migTail_--;
+        step();
+    }
+
+    void pop_front() {
+        assert(!empty());
+        Traits::destroy(alloc_, locate(head_));
+        if (inOld(head_))
+            migHead_++;
+        head_++;
+        step();
+    }
+};
+
+
+struct DeamortizedSplitLayout;
+
+// Same two-halves layout as SplitVectorStorage, but each half is an
+// IncrementalArray: taking an element from the far end of the opposite
+// half is O(1), so no rebalancing is needed at all, and growing/shrinking
+// a half is spread over the following operations. No single push or pop
+// touches more than a constant number of elements.
+template <typename T, typename Allocator>
+class DeamortizedSplitStorage {
+private:
+    typedef IncrementalArray<T, Allocator> Array;
+
+    // same orientation as in SplitVectorStorage:
+    // buffer_front_:  .- 2 1 0 [front]
+    // buffer_back_:   '- 3 4 5 [back]
+    Array buffer_front_;
+    Array buffer_back_;
+
+public:
+    DeamortizedSplitStorage(const DeamortizedSplitLayout&, const Allocator &alloc):
+        buffer_front_(alloc), buffer_back_(alloc) {}
+
+    const T& front() const {return (buffer_front_.empty() ? buffer_back_.front() : buffer_front_.back());}
+    const T& back()  const {return (buffer_back_.empty() ? buffer_front_.front() : buffer_back_.back());}
+    const T& operator[](size_t i) const {
+        size_t front_size = buffer_front_.size();
+        if (i < front_size)
+            return buffer_front_[front_size - 1 - i];
+        return buffer_back_[i - front_size];
+    }
+
+    bool empty() const {return buffer_front_.empty() && buffer_back_.empty();}
+    size_t size() const {return buffer_front_.size() + buffer_back_.size();}
+
+    // elements moved between buffers so far, the bound of the latency
+    size_t moved() const {return buffer_front_.moved() + buffer_back_.moved();}
+
+    DequeSegment<const T> segment(size_t i) const {
+        const size_t front_size = buffer_front_.size();
+        if (i >= front_size) {
+            DequeSegment<const T> seg = buffer_back_.segment(i - front_size);
+            seg.begin += front_size;
+            seg.end += front_size;
+            return seg;
+        }
+        // front half is stored back to front
+        DequeSegment<const T> run = buffer_front_.segment(front_size - 1 - i);
+        DequeSegment<const T> seg = {&run[run.size() - 1], -1, front_size - run.end, front_size - run.begin};
+        return seg;
+    }
+
+    template <typename... Args>
+    void emplace_back(Args&&... args) {buffer_back_.emplace_back(std::forward<Args>(args)...);}
+
+    template <typename... Args>
+    void emplace_front(Args&&... args) {buffer_front_.emplace_back(std::forward<Args>(args)...);}
+
+    // no reserving here: growing ahead of time would mean moving the
+    // whole half in one go
+    template <typename BidirIt>
+    void append(BidirIt first, BidirIt last) {
+        for (; first != last; ++first)
+            buffer_back_.emplace_back(*first);
+    }
+
+    template <typename BidirIt>
+    void prepend(BidirIt first, BidirIt last) {
+        while (first != last)
+            buffer_front_.emplace_back(*--last);
+    }
+
+    void pop_back() {
+        assert(!empty());
+        if (buffer_back_.empty())
+            buffer_front_.pop_front();
+        else
+            buffer_back_.pop_back();
+    }
+
+    void pop_front() {
+        assert(!empty());
+        if (buffer_front_.empty())
+            buffer_back_.pop_front();
+        else
+            buffer_front_.pop_back();
+    }
+
+    void erase_back(size_t count) {
+        assert(count <= size());
+        while (count-- > 0)
+            pop_back();
+    }
+
+    void erase_front(size_t count) {
+        assert(count <= size());
+        while (count-- > 0)
+            pop_front();
+    }
+
+private:
+    T& at(size_t i) {return const_cast<T&>((*this)[i]);}
+
+public:
+    // Moving buffers would mean a migration of unbounded length, so the
+    // smaller side is moved element by element (each step is O(1)).
+    void splice_back(DeamortizedSplitStorage &other) {
+        if (other.size() <= size()) {
+            for (; !other.empty(); other.pop_front())
+                emplace_back(std::move(other.at(0)));
+        } else {
+            for (; !empty(); pop_back())
+                other.emplace_front(std::move(at(size() - 1)));
+            std::swap(*this, other);
+        }
+    }
+
+    void splice_front(DeamortizedSplitStorage &other) {
+        other.splice_back(*this);
+        std::swap(*this, other);
+    }
+
+    // Returns [i, size()), moving the smaller of the two parts.
+    DeamortizedSplitStorage split(size_t i) {
+        assert(i <= size());
+        DeamortizedSplitStorage part(DeamortizedSplitLayout(), buffer_back_.get_allocator());
+        if (size() - i <= i) {
+            for (size_t k = i; k < size(); k++)
+                part.emplace_back(std::move(at(k)));
+            erase_back(size() - i);
+        } else {
+            for (size_t k = 0; k < i; k++)
+                part.emplace_back(std::move(at(k)));
+            erase_front(i);
+            std::swap(*this, part);
+        }
+        return part;
+    }
+};
+
+struct DeamortizedSplitLayout {
+    template <typename T, typename Allocator>
+    using storage = DeamortizedSplitStorage<T, Allocator>;
+};
+
+#endif // #ifndef DEAMORTIZED_SPLIT_STORAGE_H_INCLUDED
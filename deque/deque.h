@@ -1,23 +1,96 @@
 // https://github.com/pew-pew/mipt-hw/tree/master/deque
 
+#pragma once
+#ifndef DEQUE_H_INCLUDED
+#define DEQUE_H_INCLUDED
+
 #include <vector>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <iterator>
 #include <cassert>
 #include <algorithm>
 
+#include "deque_segment.h"
+#include "block_map_storage.h"
+#include "deamortized_split_storage.h"
+#include "ring_buffer_storage.h"
+#include "spill_storage.h"
 
-template <typename T>
-class Deque {
+
+// Shrink policies for SplitVectorStorage: a half is reallocated once
+// size * ShrinkRatio < capacity, keeping Headroom * size slots, so a queue
+// oscillating around a threshold does not reallocate on every swing.
+template <size_t ShrinkRatio, size_t Headroom>
+struct ShrinkHysteresis {
+    static_assert(Headroom >= 1 && Headroom < ShrinkRatio, "shrinking must not grow the buffer");
+
+    static bool shouldShrink(size_t size, size_t capacity) {return size * ShrinkRatio < capacity;}
+    static size_t shrinkTo(size_t size) {return size * Headroom;}
+};
+
+typedef ShrinkHysteresis<4, 1> ShrinkToFit; // the original behaviour
+
+struct NeverShrink {
+    static bool shouldShrink(size_t, size_t) {return false;}
+    static size_t shrinkTo(size_t size) {return size;}
+};
+
+
+// Stats policies for SplitVectorStorage. NoStats is empty and its hooks
+// are never called, so a storage without stats has no extra members and
+// the same code; DequeStats counts what the storage does with its buffers.
+struct NoStats {
+    static const bool enabled = false;
+
+    void onRebalance(size_t) {}
+    void onShrink() {}
+    void onCapacity(size_t) {}
+};
+
+struct DequeStats {
+    static const bool enabled = true;
+
+    size_t rebalances;    // pops and erases that moved elements to the other half
+    size_t elementsMoved; // by those rebalances
+    size_t shrinks;       // tryShrink reallocations
+    size_t peakCapacity;  // of both halves together, in elements
+
+    DequeStats(): rebalances(0), elementsMoved(0), shrinks(0), peakCapacity(0) {}
+
+    void onRebalance(size_t moved) {
+        rebalances++;
+        elementsMoved += moved;
+    }
+
+    void onShrink() {shrinks++;}
+    void onCapacity(size_t capacity) {peakCapacity = std::max(peakCapacity, capacity);}
+};
+
+
+template <typename Shrink, typename Stats> struct SplitVectorLayout;
+
+// Stats is a private base, so an empty one takes no space.
+template <typename T, typename Allocator, typename Shrink, typename Stats>
+class SplitVectorStorage : private Stats {
 private:
     template <typename U>
-    class ShrinkingVector : public std::vector<U> {
-        typedef std::vector<U> Base;
+    class ShrinkingVector : public std::vector<U, Allocator> {
+        typedef std::vector<U, Allocator> Base;
     
     public:
         using Base::Base;
 
-        void tryShrink() {
-            if (Base::size() * 4 < Base::capacity())
-                Base::shrink_to_fit();
+        // returns whether the buffer was reallocated
+        bool tryShrink() {
+            if (!Shrink::shouldShrink(Base::size(), Base::capacity()))
+                return false;
+            ShrinkingVector shrunk(Base::get_allocator());
+            shrunk.reserve(Shrink::shrinkTo(Base::size()));
+            std::move(Base::begin(), Base::end(), std::back_inserter(shrunk));
+            Base::swap(shrunk);
+            return true;
         }
     };
 
@@ -28,8 +101,19 @@ private:
     Vector buffer_front_;
     Vector buffer_back_;
 
+    void tryShrink(Vector &buf) {
+        if (buf.tryShrink() && Stats::enabled)
+            Stats::onShrink();
+    }
+
+    void noteCapacity() {
+        if (Stats::enabled)
+            Stats::onCapacity(buffer_front_.capacity() + buffer_back_.capacity());
+    }
+
 public:
-    Deque(): buffer_front_(0), buffer_back_(0) {}
+    SplitVectorStorage(const SplitVectorLayout<Shrink, Stats>&, const Allocator &alloc):
+        buffer_front_(alloc), buffer_back_(alloc) {}
 
     const T& front() const { return (buffer_front_.empty() ? buffer_back_.front()  : buffer_front_.back());}
     const T& back()  const { return (buffer_back_.empty()  ? buffer_front_.front() : buffer_back_.back());}
@@ -39,21 +123,54 @@ public:
         return buffer_back_[i - buffer_front_.size()];
     }
 
-    T& front() {return const_cast<T&>(const_cast<const Deque*>(this)->front());}
-    T& back()  {return const_cast<T&>(const_cast<const Deque*>(this)->back());}
-    T& operator[](size_t i) {return const_cast<T&>(const_cast<const Deque*>(this)->operator[](i));}
-
     bool empty() const {return buffer_front_.empty() && buffer_back_.empty();};
     size_t size() const {return buffer_front_.size() + buffer_back_.size();};
 
-    void push_back(const T& val){buffer_back_.push_back(val);}
-    void push_front(const T& val) {buffer_front_.push_back(val);}
-    
-    void push_back(T&& val) {buffer_back_.push_back(std::move(val));}
-    void push_front(T&& val) {buffer_front_.push_back(std::move(val));}
+    DequeSegment<const T> segment(size_t i) const {
+        const size_t front_size = buffer_front_.size();
+        if (i < front_size) {
+            DequeSegment<const T> seg = {&buffer_front_.back(), -1, 0, front_size};
+            return seg;
+        }
+        DequeSegment<const T> seg = {buffer_back_.data(), 1, front_size, size()};
+        return seg;
+    }
+
+    // NoStats has nothing to read
+    const Stats& stats() const {return *this;}
+    void reset_stats() {
+        static_cast<Stats&>(*this) = Stats();
+        noteCapacity();
+    }
+
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        buffer_back_.emplace_back(std::forward<Args>(args)...);
+        noteCapacity();
+    }
+
+    template <typename... Args>
+    void emplace_front(Args&&... args) {
+        buffer_front_.emplace_back(std::forward<Args>(args)...);
+        noteCapacity();
+    }
+
+    // vector::insert reserves once for the whole range
+    template <typename BidirIt>
+    void append(BidirIt first, BidirIt last) {
+        buffer_back_.insert(buffer_back_.end(), first, last);
+        noteCapacity();
+    }
+
+    template <typename BidirIt>
+    void prepend(BidirIt first, BidirIt last) {
+        buffer_front_.insert(buffer_front_.end(), std::reverse_iterator<BidirIt>(last),
+                                                  std::reverse_iterator<BidirIt>(first));
+        noteCapacity();
+    }
     
 private:
-    template <Vector Deque::*BUF_FRONT, Vector Deque::*BUF_BACK>
+    template <Vector SplitVectorStorage::*BUF_FRONT, Vector SplitVectorStorage::*BUF_BACK>
     void pop_back_() {
         assert(size() > 0);
         Vector &buf_front = (*this).*BUF_FRONT;
@@ -65,60 +182,383 @@ private:
             std::move(buf_front.rend() - pop_size, buf_front.rend(), std::back_inserter(buf_back));
             std::move(buf_front.begin() + pop_size, buf_front.end(), buf_front.begin());
             buf_front.resize(buf_front.size() - pop_size);
-            buf_front.tryShrink();
+            if (Stats::enabled) {
+                Stats::onRebalance(pop_size);
+                noteCapacity();
+            }
+            tryShrink(buf_front);
         }
         buf_back.pop_back();
-        buf_back.tryShrink();
+        tryShrink(buf_back);
     }
 
 public:
     void pop_back() {
-        pop_back_<&Deque::buffer_front_, &Deque::buffer_back_>();
+        pop_back_<&SplitVectorStorage::buffer_front_, &SplitVectorStorage::buffer_back_>();
     }
 
     void pop_front() {
-        pop_back_<&Deque::buffer_back_, &Deque::buffer_front_>();
+        pop_back_<&SplitVectorStorage::buffer_back_, &SplitVectorStorage::buffer_front_>();
+    }
+
+private:
+    template <Vector SplitVectorStorage::*BUF_FRONT, Vector SplitVectorStorage::*BUF_BACK>
+    void erase_back_(size_t count) {
+        assert(count <= size());
+        Vector &buf_front = (*this).*BUF_FRONT;
+        Vector &buf_back  = (*this).*BUF_BACK;
+
+        const size_t from_back = std::min(count, buf_back.size());
+        buf_back.erase(buf_back.end() - from_back, buf_back.end());
+
+        const size_t from_front = count - from_back;
+        if (from_front > 0) {
+            // like pop_back_: also move half of what is left across,
+            // so that the following erases do not shift buf_front again
+            const size_t left = buf_front.size() - from_front;
+            const size_t move_size = left - left / 2;
+            typename Vector::iterator move_begin = buf_front.begin() + from_front;
+            buf_back.reserve(move_size);
+            std::move(std::reverse_iterator<typename Vector::iterator>(move_begin + move_size),
+                      std::reverse_iterator<typename Vector::iterator>(move_begin),
+                      std::back_inserter(buf_back));
+            buf_front.erase(buf_front.begin(), move_begin + move_size);
+            if (Stats::enabled) {
+                Stats::onRebalance(move_size);
+                noteCapacity();
+            }
+        }
+        tryShrink(buf_back);
+        tryShrink(buf_front);
+    }
+
+public:
+    void erase_back(size_t count) {
+        erase_back_<&SplitVectorStorage::buffer_front_, &SplitVectorStorage::buffer_back_>(count);
+    }
+
+    void erase_front(size_t count) {
+        erase_back_<&SplitVectorStorage::buffer_back_, &SplitVectorStorage::buffer_front_>(count);
+    }
+
+private:
+    // Only the elements between the two outer halves have to move, and
+    // they can go either way: other's onto buf_back, or ours onto
+    // other's front half, which then becomes ours.
+    template <Vector SplitVectorStorage::*BUF_FRONT, Vector SplitVectorStorage::*BUF_BACK>
+    void splice_back_(SplitVectorStorage &other) {
+        Vector &buf_front = (*this).*BUF_FRONT;
+        Vector &buf_back  = (*this).*BUF_BACK;
+        Vector &other_front = other.*BUF_FRONT;
+        Vector &other_back  = other.*BUF_BACK;
+
+        if (buf_back.empty() && other_front.empty()) {
+            buf_back.swap(other_back);
+        } else if (other.size() <= size()) {
+            buf_back.insert(buf_back.end(), std::make_move_iterator(other_front.rbegin()),
+                                            std::make_move_iterator(other_front.rend()));
+            buf_back.insert(buf_back.end(), std::make_move_iterator(other_back.begin()),
+                                            std::make_move_iterator(other_back.end()));
+        } else {
+            other_front.insert(other_front.end(), std::make_move_iterator(buf_back.rbegin()),
+                                                  std::make_move_iterator(buf_back.rend()));
+            other_front.insert(other_front.end(), std::make_move_iterator(buf_front.begin()),
+                                                  std::make_move_iterator(buf_front.end()));
+            buf_front.swap(other_front);
+            buf_back.swap(other_back);
+        }
+        other_front.clear();
+        other_back.clear();
+        other.tryShrink(other_front);
+        other.tryShrink(other_back);
+        noteCapacity();
+    }
+
+public:
+    // O(1) if other is empty or starts right at our back half's end
+    // (nothing in between), otherwise O(min(size(), other.size())).
+    // Both sides must use equal allocators.
+    void splice_back(SplitVectorStorage &other) {
+        splice_back_<&SplitVectorStorage::buffer_front_, &SplitVectorStorage::buffer_back_>(other);
+    }
+
+    void splice_front(SplitVectorStorage &other) {
+        splice_back_<&SplitVectorStorage::buffer_back_, &SplitVectorStorage::buffer_front_>(other);
+    }
+
+    // Returns [i, size()), keeping [0, i). O(1) at the border of the
+    // halves, otherwise the part of the split half nearer to that border moves.
+    SplitVectorStorage split(size_t i) {
+        assert(i <= size());
+        SplitVectorStorage tail(SplitVectorLayout<Shrink, Stats>(), buffer_back_.get_allocator());
+        const size_t front_size = buffer_front_.size();
+
+        if (i >= front_size) {
+            const typename Vector::iterator from = buffer_back_.begin() + (i - front_size);
+            if (from == buffer_back_.begin()) {
+                buffer_back_.swap(tail.buffer_back_);
+            } else {
+                tail.buffer_back_.insert(tail.buffer_back_.end(), std::make_move_iterator(from),
+                                                                  std::make_move_iterator(buffer_back_.end()));
+                buffer_back_.erase(from, buffer_back_.end());
+            }
+        } else {
+            // buffer_front_ ends with our i elements; the rest of it goes as a whole
+            buffer_back_.swap(tail.buffer_back_);
+            buffer_front_.swap(tail.buffer_front_);
+            const typename Vector::iterator from = tail.buffer_front_.end() - i;
+            buffer_front_.insert(buffer_front_.end(), std::make_move_iterator(from),
+                                                      std::make_move_iterator(tail.buffer_front_.end()));
+            tail.buffer_front_.erase(from, tail.buffer_front_.end());
+        }
+        tryShrink(buffer_front_);
+        tryShrink(buffer_back_);
+        return tail;
+    }
+};
+
+template <typename Shrink = ShrinkToFit, typename Stats = NoStats>
+struct SplitVectorLayout {
+    template <typename T, typename Allocator>
+    using storage = SplitVectorStorage<T, Allocator, Shrink, Stats>;
+};
+
+
+// Layout selects the storage engine:
+//   SplitVectorLayout<>    - two vectors growing away from the middle (amortized O(1))
+//   DeamortizedSplitLayout - same halves, with growth spread over later operations (worst-case O(1))
+//   BlockMapLayout<>       - fixed-size chunks behind a map (worst-case O(1), stable references)
+//   RingBufferLayout<>     - one circular buffer of bounded capacity (see RingOverflow)
+//   SpillLayout            - segments, all but the ones near the ends spilled to files
+// All of them get their memory from Allocator (see buffer_pool.h for a recycling one).
+template <typename T, typename Layout = SplitVectorLayout<>, typename Allocator = std::allocator<T>>
+class Deque {
+private:
+    typedef typename Layout::template storage<T, Allocator> Storage;
+    Storage storage_;
+
+    explicit Deque(Storage &&storage): storage_(std::move(storage)) {}
+
+public:
+    typedef Allocator allocator_type;
+    // void, or bool for RingBufferLayout: whether the element was stored
+    typedef decltype(std::declval<Storage&>().emplace_back(std::declval<T>())) push_result;
+
+    explicit Deque(const Allocator &alloc = Allocator()): storage_(Layout(), alloc) {}
+
+    // for layouts with run-time settings, e.g. Deque<int, RingBufferLayout<>> d(RingBufferLayout<>(1024));
+    explicit Deque(const Layout &layout, const Allocator &alloc = Allocator()): storage_(layout, alloc) {}
+
+    const T& front() const {return storage_.front();}
+    const T& back()  const {return storage_.back();}
+    const T& operator[](size_t i) const {return storage_[i];}
+
+    T& front() {return const_cast<T&>(const_cast<const Deque*>(this)->front());}
+    T& back()  {return const_cast<T&>(const_cast<const Deque*>(this)->back());}
+    T& operator[](size_t i) {return const_cast<T&>(const_cast<const Deque*>(this)->operator[](i));}
+
+    bool empty() const {return storage_.empty();}
+    size_t size() const {return storage_.size();}
+
+    // Counters of layouts with a stats policy, e.g.
+    // Deque<int, SplitVectorLayout<ShrinkToFit, DequeStats>>. stats() is a snapshot.
+    template <typename S = Storage>
+    auto stats() const -> typename std::decay<decltype(std::declval<const S&>().stats())>::type {
+        return storage_.stats();
+    }
+
+    template <typename S = Storage>
+    auto reset_stats() -> decltype(std::declval<S&>().reset_stats()) {
+        storage_.reset_stats();
+    }
+
+    push_result push_back(const T& val) {return storage_.emplace_back(val);}
+    push_result push_front(const T& val) {return storage_.emplace_front(val);}
+
+    push_result push_back(T&& val) {return storage_.emplace_back(std::move(val));}
+    push_result push_front(T&& val) {return storage_.emplace_front(std::move(val));}
+
+    template <typename... Args>
+    push_result emplace_back(Args&&... args) {return storage_.emplace_back(std::forward<Args>(args)...);}
+
+    template <typename... Args>
+    push_result emplace_front(Args&&... args) {return storage_.emplace_front(std::forward<Args>(args)...);}
+
+    void pop_back() {storage_.pop_back();}
+    void pop_front() {storage_.pop_front();}
+
+    // Move all elements of other after back() / before front(), leaving it
+    // empty. Whole buffers or chunks change hands where the layout allows,
+    // see splice_back of the storage for the cost. Both deques must use
+    // equal allocators.
+    void splice_back(Deque &&other) {
+        assert(&other != this);
+        storage_.splice_back(other.storage_);
+    }
+
+    void splice_front(Deque &&other) {
+        assert(&other != this);
+        storage_.splice_front(other.storage_);
+    }
+
+    // Removes elements [i, size()) and returns them as a new deque.
+    Deque split_at(size_t i) {
+        assert(i <= size());
+        return Deque(storage_.split(i));
+    }
+
+    // Adds [first, last) after back(), keeping its order.
+    template <typename InputIt>
+    void append(InputIt first, InputIt last) {
+        append_(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+    }
+
+    // Adds [first, last) before front(), keeping its order: front() == *first afterwards.
+    template <typename InputIt>
+    void prepend(InputIt first, InputIt last) {
+        prepend_(first, last, typename std::iterator_traits<InputIt>::iterator_category());
+    }
+
+    // Move up to count elements from the front into out[0..], in deque order.
+    // Returns how many were moved.
+    size_t pop_front_n(T *out, size_t count) {
+        count = std::min(count, size());
+        for (size_t done = 0; done < count; ) {
+            DequeSegment<T> seg = segment_at(done);
+            size_t from = done - seg.begin;
+            size_t len = std::min(seg.end, count) - done;
+            for (size_t i = 0; i < len; i++)
+                out[done + i] = std::move(seg[from + i]);
+            done += len;
+        }
+        storage_.erase_front(count);
+        return count;
+    }
+
+    // Move up to count elements from the back into out[0..], in pop order
+    // (out[0] is the old back()). Returns how many were moved.
+    size_t pop_back_n(T *out, size_t count) {
+        count = std::min(count, size());
+        const size_t last = size() - 1;
+        for (size_t done = 0; done < count; ) {
+            DequeSegment<T> seg = segment_at(last - done);
+            size_t from = last - done - seg.begin;
+            size_t len = std::min(from + 1, count - done);
+            for (size_t i = 0; i < len; i++)
+                out[done + i] = std::move(seg[from - i]);
+            done += len;
+        }
+        storage_.erase_back(count);
+        return count;
+    }
+
+private:
+    template <typename InputIt>
+    void append_(InputIt first, InputIt last, std::input_iterator_tag) {
+        for (; first != last; ++first)
+            storage_.emplace_back(*first);
+    }
+
+    template <typename BidirIt>
+    void append_(BidirIt first, BidirIt last, std::bidirectional_iterator_tag) {
+        storage_.append(first, last);
+    }
+
+    template <typename InputIt>
+    void prepend_(InputIt first, InputIt last, std::input_iterator_tag) {
+        std::vector<T> buffered(first, last);
+        storage_.prepend(std::make_move_iterator(buffered.begin()), std::make_move_iterator(buffered.end()));
+    }
+
+    template <typename BidirIt>
+    void prepend_(BidirIt first, BidirIt last, std::bidirectional_iterator_tag) {
+        storage_.prepend(first, last);
+    }
+
+public:
+
+    // Contiguous run of elements containing element i.
+    DequeSegment<const T> segment_at(size_t i) const {
+        assert(i < size());
+        return storage_.segment(i);
+    }
+
+    DequeSegment<T> segment_at(size_t i) {
+        DequeSegment<const T> seg = const_cast<const Deque*>(this)->segment_at(i);
+        DequeSegment<T> mutableSeg = {const_cast<T*>(seg.first), seg.step, seg.begin, seg.end};
+        return mutableSeg;
     }
 
 private:
+    // Caches the segment around the current element, so dereferencing is
+    // a plain pointer access and the segment is looked up again only when
+    // the iterator leaves it.
     template <typename DequeT, typename ValT>
     class DequeIteratorT : public std::iterator<std::random_access_iterator_tag, ValT> {
     private:
         DequeT *p_deque;
         size_t index;
+        ValT *cur;         // element number index, if it is inside the segment
+        ptrdiff_t step;
+        size_t seg_begin;
+        size_t seg_end;
         typedef typename std::iterator_traits<DequeIteratorT>::difference_type diff_type;
     
-        DequeIteratorT(DequeT *deque, size_t index): p_deque(deque), index(index) {}
-        friend class Deque<T>;
+        DequeIteratorT(DequeT *deque, size_t index):
+                p_deque(deque), index(index), cur(NULL), step(0), seg_begin(index), seg_end(index) {
+            reload();
+        }
+        friend class Deque;
+        template <typename, typename> friend class DequeIteratorT;
+
+        void reload() {
+            if (index >= p_deque->size()) {
+                seg_begin = seg_end = index;
+                return;
+            }
+            DequeSegment<ValT> seg = p_deque->segment_at(index);
+            cur = &seg[index - seg.begin];
+            step = seg.step;
+            seg_begin = seg.begin;
+            seg_end = seg.end;
+        }
+
+        void advance(diff_type diff) {
+            index += diff;
+            if (index - seg_begin < seg_end - seg_begin)
+                cur += step * diff;
+            else
+                reload();
+        }
     
     public:
-        DequeIteratorT(): p_deque(NULL), index(0) {}
+        DequeIteratorT(): p_deque(NULL), index(0), cur(NULL), step(0), seg_begin(0), seg_end(0) {}
 
         operator DequeIteratorT<const DequeT, const ValT>() const {
             return DequeIteratorT<const DequeT, const ValT>(p_deque, index);
         }
 
-        ValT& operator[](diff_type i) {
+        ValT& operator[](diff_type i) const {
             assert(p_deque != NULL);
-            return (*p_deque)[index + i];
+            return *(*this + i);
         }
 
-        ValT& operator*()  {return  (*this)[0];}
-        ValT* operator->() {return &(*this)[0];}
+        ValT& operator*()  const {return *cur;}
+        ValT* operator->() const {return cur;}
 
-        bool operator<(const DequeIteratorT &other) {return index < other.index;}
-        bool operator>(const DequeIteratorT &other) {return index > other.index;}
-        bool operator<=(const DequeIteratorT &other) {return index <= other.index;}
-        bool operator>=(const DequeIteratorT &other) {return index >= other.index;}
-        bool operator==(const DequeIteratorT &other) {return index == other.index;}
-        bool operator!=(const DequeIteratorT &other) {return index != other.index;}
+        bool operator<(const DequeIteratorT &other) const {return index < other.index;}
+        bool operator>(const DequeIteratorT &other) const {return index > other.index;}
+        bool operator<=(const DequeIteratorT &other) const {return index <= other.index;}
+        bool operator>=(const DequeIteratorT &other) const {return index >= other.index;}
+        bool operator==(const DequeIteratorT &other) const {return index == other.index;}
+        bool operator!=(const DequeIteratorT &other) const {return index != other.index;}
 
-        DequeIteratorT operator++(int) {return DequeIteratorT(p_deque, index++);}
-        DequeIteratorT operator--(int) {return DequeIteratorT(p_deque, index--);}
-        DequeIteratorT& operator++() {index++; return *this;}
-        DequeIteratorT& operator--() {index--; return *this;}
-        DequeIteratorT& operator+=(diff_type diff) { index += diff; return *this;}
-        DequeIteratorT& operator-=(diff_type diff) { index -= diff; return *this;}
+        DequeIteratorT operator++(int) {DequeIteratorT old(*this); advance(1); return old;}
+        DequeIteratorT operator--(int) {DequeIteratorT old(*this); advance(-1); return old;}
+        DequeIteratorT& operator++() {advance(1); return *this;}
+        DequeIteratorT& operator--() {advance(-1); return *this;}
+        DequeIteratorT& operator+=(diff_type diff) {advance(diff); return *this;}
+        DequeIteratorT& operator-=(diff_type diff) {advance(-diff); return *this;}
         
         DequeIteratorT operator+(diff_type diff) const {return DequeIteratorT(*this) += diff;}
         DequeIteratorT operator-(diff_type diff) const {return DequeIteratorT(*this) -= diff;}
@@ -132,6 +572,52 @@ private:
         }
     };
 
+    template <typename DequeT, typename ValT>
+    class SegmentIteratorT : public std::iterator<std::forward_iterator_tag, DequeSegment<ValT>, ptrdiff_t,
+                                                  const DequeSegment<ValT>*, const DequeSegment<ValT>&> {
+    private:
+        DequeT *p_deque;
+        DequeSegment<ValT> seg;
+
+        SegmentIteratorT(DequeT *deque, size_t index): p_deque(deque), seg() {
+            load(index);
+        }
+        friend class Deque;
+
+        void load(size_t index) {
+            if (index < p_deque->size()) {
+                seg = p_deque->segment_at(index);
+            } else {
+                DequeSegment<ValT> past_end = {NULL, 1, index, index};
+                seg = past_end;
+            }
+        }
+
+    public:
+        SegmentIteratorT(): p_deque(NULL), seg() {}
+
+        const DequeSegment<ValT>& operator*()  const {return seg;}
+        const DequeSegment<ValT>* operator->() const {return &seg;}
+
+        bool operator==(const SegmentIteratorT &other) const {return seg.begin == other.seg.begin;}
+        bool operator!=(const SegmentIteratorT &other) const {return seg.begin != other.seg.begin;}
+
+        SegmentIteratorT& operator++() {load(seg.end); return *this;}
+        SegmentIteratorT operator++(int) {SegmentIteratorT old(*this); load(seg.end); return old;}
+    };
+
+    template <typename SegmentIterator>
+    class SegmentRange {
+    private:
+        SegmentIterator first_, last_;
+
+    public:
+        SegmentRange(SegmentIterator first, SegmentIterator last): first_(first), last_(last) {}
+
+        SegmentIterator begin() const {return first_;}
+        SegmentIterator end()   const {return last_;}
+    };
+
 public:
     typedef DequeIteratorT<Deque, T> iterator;
     typedef DequeIteratorT<const Deque, const T> const_iterator;
@@ -153,5 +639,19 @@ public:
     reverse_iterator       rend()        {return       reverse_iterator(begin());}
     const_reverse_iterator rend()  const {return const_reverse_iterator(begin());}
     const_reverse_iterator crend() const {return const_reverse_iterator(begin());}
+
+    typedef SegmentIteratorT<Deque, T> segment_iterator;
+    typedef SegmentIteratorT<const Deque, const T> const_segment_iterator;
+
+    // Contiguous runs of elements in deque order. Forward ones can go
+    // straight to memcpy(out + seg.begin, seg.data(), seg.size() * sizeof(T)).
+    SegmentRange<segment_iterator> segments() {
+        return SegmentRange<segment_iterator>(segment_iterator(this, 0), segment_iterator(this, size()));
+    }
+
+    SegmentRange<const_segment_iterator> segments() const {
+        return SegmentRange<const_segment_iterator>(const_segment_iterator(this, 0), const_segment_iterator(this, size()));
+    }
 };
 
+#endif // #ifndef DEQUE_H_INCLUDED
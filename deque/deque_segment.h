@@ -0,0 +1,27 @@
+#pragma once
+#ifndef DEQUE_SEGMENT_H_INCLUDED
+#define DEQUE_SEGMENT_H_INCLUDED
+
+#include <cstddef>
+
+
+// A run of deque elements [begin, end) that are contiguous in memory.
+// Halves that are stored back to front (the front half of the split
+// layouts) come with step == -1; data() is the lowest address either way,
+// so a forward segment can be handed straight to memcpy or a SIMD kernel.
+template <typename T>
+struct DequeSegment {
+    T *first;       // element number `begin`
+    ptrdiff_t step; // 1 or -1
+    size_t begin;
+    size_t end;
+
+    size_t size() const {return end - begin;}
+    bool reversed() const {return step < 0;}
+    T* data() const {return (step > 0 ? first : first - static_cast<ptrdiff_t>(size() - 1));}
+
+    // i-th element of the segment in deque order
+    T& operator[](size_t i) const {return first[step * static_cast<ptrdiff_t>(i)];}
+};
+
+#endif // #ifndef DEQUE_SEGMENT_H_INCLUDED
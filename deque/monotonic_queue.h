@@ -0,0 +1,99 @@
+#pragma once
+#ifndef MONOTONIC_QUEUE_H_INCLUDED
+#define MONOTONIC_QUEUE_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+
+#include "deque.h"
+
+
+// FIFO window that knows its minimum and maximum (by Compare).
+//
+// Only the candidates are kept: an element is dropped from mins_ as soon as
+// a newer one is not greater than it, as it can never be the minimum again
+// (and the same for maxs_). Every element enters and leaves each deque at
+// most once, so push, pop, min and max are amortized O(1). Elements are
+// numbered by push order, which is how pop() recognizes the candidate
+// leaving the window. The deques default to a growing ring buffer, which
+// settles at the size of the window.
+template <typename T, typename Compare = std::less<T>,
+          typename Layout = RingBufferLayout<0, RingOverflow::Grow>>
+class MonotonicQueue {
+private:
+    typedef std::pair<size_t, T> Entry;
+
+    Compare comp_;
+    Deque<Entry, Layout> mins_; // increasing values, by position
+    Deque<Entry, Layout> maxs_; // decreasing values, by position
+    size_t head_;               // number of the oldest element
+    size_t tail_;               // number of the next pushed element
+
+public:
+    explicit MonotonicQueue(const Compare &comp = Compare()):
+        comp_(comp), mins_(), maxs_(), head_(0), tail_(0) {}
+
+    bool empty() const {return head_ == tail_;}
+    size_t size() const {return tail_ - head_;}
+
+    const T& min() const {assert(!empty()); return mins_.front().second;}
+    const T& max() const {assert(!empty()); return maxs_.front().second;}
+
+    void push(const T &val) {
+        while (!mins_.empty() && !comp_(mins_.back().second, val))
+            mins_.pop_back();
+        while (!maxs_.empty() && !comp_(val, maxs_.back().second))
+            maxs_.pop_back();
+        mins_.emplace_back(tail_, val);
+        maxs_.emplace_back(tail_, val);
+        tail_++;
+    }
+
+    // removes the oldest element
+    void pop() {
+        assert(!empty());
+        if (mins_.front().first == head_)
+            mins_.pop_front();
+        if (maxs_.front().first == head_)
+            maxs_.pop_front();
+        head_++;
+    }
+};
+
+
+// Writes the minimum of every window [i, i + width) of [first, last) to
+// out, in one pass: the same candidate deque as in MonotonicQueue, holding
+// input positions only. Returns the end of the output
+// (max(0, last - first - width + 1) values). std::greater gives maxima.
+template <typename RandomIt, typename OutputIt, typename Compare>
+OutputIt windowMinima(RandomIt first, RandomIt last, size_t width, OutputIt out, Compare comp) {
+    typedef RingBufferLayout<0, RingOverflow::Grow> Layout;
+    assert(width > 0);
+    const size_t count = static_cast<size_t>(last - first);
+    // there are never more than width + 1 candidates
+    Deque<size_t, Layout> candidates(Layout(std::min(width, count) + 1));
+    for (size_t i = 0; i < count; i++) {
+        while (!candidates.empty() && !comp(first[candidates.back()], first[i]))
+            candidates.pop_back();
+        candidates.push_back(i);
+
+        if (i + 1 < width)
+            continue;
+        if (candidates.front() + width <= i)
+            candidates.pop_front();
+        *out++ = first[candidates.front()];
+    }
+    return out;
+}
+
+template <typename RandomIt, typename OutputIt>
+OutputIt windowMinima(RandomIt first, RandomIt last, size_t width, OutputIt out) {
+    typedef typename std::iterator_traits<RandomIt>::value_type T;
+    return windowMinima(first, last, width, out, std::less<T>());
+}
+
+#endif // #ifndef MONOTONIC_QUEUE_H_INCLUDED
@@ -0,0 +1,204 @@
+// Performance sweep over containers, operation mixes and sizes, printed as
+// CSV (one row per run) for plot.py:
+//
+//   perf_deque [max_size] [mix]... > perf.csv
+//   python3 plot.py perf.csv [baseline.csv]
+//
+// Every run goes in a forked child, so the peak RSS it reports belongs to
+// that run alone. A run is executed twice with the same seed: once plainly
+// for throughput, once with every operation timed for the latency
+// percentiles (the clock calls would skew the throughput).
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "deque.h"
+
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+using std::chrono::nanoseconds;
+
+
+// Workloads, each of `size` operations:
+//   push    - push_back into an empty container
+//   fifo    - push_back, or pop_front with probability 1/3
+//   lifo    - push_back, or pop_back with probability 1/3
+//   random  - the same at random ends
+//   iterate - one iterator step over a filled container
+//   index   - operator[] at a random position of a filled container
+static const char *const kMixes[] = {"push", "fifo", "lifo", "random", "iterate", "index"};
+
+// Keeps the compiler from throwing a computed result away.
+static volatile long long sink;
+
+template <typename Container>
+struct HasFront {
+    static const bool value = true;
+};
+
+template <typename T>
+struct HasFront<std::vector<T>> {
+    static const bool value = false;
+};
+
+// only called where HasFront holds
+template <typename Container>
+void pushFront(Container &c, int val) {c.push_front(val);}
+template <typename Container>
+void popFront(Container &c) {c.pop_front();}
+
+template <>
+void pushFront(std::vector<int>&, int) {std::abort();}
+template <>
+void popFront(std::vector<int>&) {std::abort();}
+
+template <bool Timed, typename Op>
+void runOps(size_t ops, std::vector<long long> &latencies, Op op) {
+    for (size_t i = 0; i < ops; i++) {
+        if (Timed) {
+            auto start = steady_clock::now();
+            op(i);
+            latencies[i] = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+        } else {
+            op(i);
+        }
+    }
+}
+
+template <bool Timed, typename Container>
+void runMix(const std::string &mix, size_t size, std::vector<long long> &latencies) {
+    std::minstd_rand rng(42);
+    Container c;
+
+    if (mix == "push") {
+        runOps<Timed>(size, latencies, [&](size_t i) {c.push_back(static_cast<int>(i));});
+    } else if (mix == "fifo" || mix == "lifo") {
+        const bool fifo = (mix == "fifo");
+        runOps<Timed>(size, latencies, [&](size_t i) {
+            if (!c.empty() && rng() % 3 == 0) {
+                if (fifo) popFront(c);
+                else      c.pop_back();
+            } else {
+                c.push_back(static_cast<int>(i));
+            }
+        });
+    } else if (mix == "random") {
+        runOps<Timed>(size, latencies, [&](size_t i) {
+            unsigned r = rng();
+            if (!c.empty() && r % 3 == 0) {
+                if (r & 8) c.pop_back();
+                else       popFront(c);
+            } else {
+                if (r & 8) c.push_back(static_cast<int>(i));
+                else       pushFront(c, static_cast<int>(i));
+            }
+        });
+    } else if (mix == "iterate") {
+        for (size_t i = 0; i < size; i++)
+            c.push_back(static_cast<int>(i));
+        typename Container::const_iterator it = c.cbegin();
+        long long sum = 0;
+        runOps<Timed>(size, latencies, [&](size_t) {sum += *it++;});
+        sink = sum;
+    } else if (mix == "index") {
+        for (size_t i = 0; i < size; i++)
+            c.push_back(static_cast<int>(i));
+        long long sum = 0;
+        runOps<Timed>(size, latencies, [&](size_t) {sum += c[rng() % size];});
+        sink = sum;
+    }
+    sink = static_cast<long long>(c.size());
+}
+
+long long percentile(std::vector<long long> &values, double p) {
+    size_t k = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+template <typename Container>
+void runChild(const std::string &name, const std::string &mix, size_t size) {
+    std::vector<long long> latencies;
+    auto start = steady_clock::now();
+    runMix<false, Container>(mix, size, latencies);
+    double seconds = duration_cast<duration<double>>(steady_clock::now() - start).count();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    latencies.resize(size);
+    runMix<true, Container>(mix, size, latencies);
+
+    std::printf("%s,%s,%zu,%.6f,%.3f,%lld,%lld,%lld,%ld\n", name.c_str(), mix.c_str(), size, seconds,
+                size / seconds / 1e6, percentile(latencies, 0.5), percentile(latencies, 0.99),
+                *std::max_element(latencies.begin(), latencies.end()), usage.ru_maxrss);
+    std::fflush(stdout);
+}
+
+template <typename Container>
+bool runForked(const std::string &name, const std::string &mix, size_t size) {
+    if (!HasFront<Container>::value && (mix == "fifo" || mix == "random"))
+        return true;
+
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        runChild<Container>(name, mix, size);
+        _exit(0);
+    }
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << name << " " << mix << " " << size << ": run failed" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    size_t maxSize = (argc > 1 ? std::strtoull(argv[1], NULL, 10) : 10000000);
+    std::vector<std::string> mixes(argv + std::min(argc, 2), argv + argc);
+    if (mixes.empty())
+        mixes.assign(std::begin(kMixes), std::end(kMixes));
+
+    std::printf("container,mix,size,seconds,mops_per_s,p50_ns,p99_ns,max_ns,peak_rss_kb\n");
+    bool ok = true;
+    for (const std::string &mix : mixes) {
+        if (std::find(std::begin(kMixes), std::end(kMixes), mix) == std::end(kMixes)) {
+            std::cerr << "unknown mix: " << mix << std::endl;
+            return 1;
+        }
+        std::vector<size_t> sizes;
+        for (size_t size = 1000; size <= maxSize; size *= 10) {
+            sizes.push_back(size);
+            if (size * 3 <= maxSize)
+                sizes.push_back(size * 3);
+        }
+        for (size_t size : sizes) {
+            ok &= runForked<Deque<int>>("split", mix, size);
+            ok &= runForked<Deque<int, DeamortizedSplitLayout>>("deamortized", mix, size);
+            ok &= runForked<Deque<int, BlockMapLayout<>>>("block_map", mix, size);
+            ok &= runForked<std::deque<int>>("std::deque", mix, size);
+            ok &= runForked<std::vector<int>>("std::vector", mix, size);
+        }
+    }
+    return (ok ? 0 : 1);
+}
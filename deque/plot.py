@@ -1,20 +1,70 @@
-from matplotlib import pyplot as plt
+# usage: python3 plot.py perf.csv [baseline.csv]
+#
+# Plots throughput and p99 latency against size for every operation mix of
+# a perf_deque run into plot.png. With a baseline run, also lists the runs
+# that got slower and exits with 1 if there are any.
 
-def readTimes(fname):
+import csv
+import sys
+from collections import defaultdict
+
+THROUGHPUT_DROP = 0.15 # relative
+P99_GROWTH = 0.5       # relative
+
+def readRuns(fname):
     with open(fname, "rt") as f:
-        return [list(map(int, line.split())) for line in f.readlines()]
-
-def plotTimes(data, **kwargs):
-    ns = [n for (n, _) in data]
-    ts = [t for (_, t) in data]
-    
-    #ks = [n / t for (n, t) in data]
-    #kMid = sum(ks) / len(ks)
-    #errors = [abs(k - kMid) / abs((k + kMid) / 2) for k in ks]
-    
-    plt.plot(ns, ts, **kwargs)
-    plt.scatter(ns, ts, **kwargs)
-
-plotTimes(readTimes("times.txt"))
-plt.savefig("plot.png")
-plt.show()
+        return list(csv.DictReader(f))
+
+def byKey(runs):
+    return {(r["container"], r["mix"], int(r["size"])): r for r in runs}
+
+def plotRuns(runs):
+    from matplotlib import pyplot as plt
+
+    mixes = sorted(set(r["mix"] for r in runs), key=[r["mix"] for r in runs].index)
+    fig, axes = plt.subplots(len(mixes), 2, figsize=(12, 3.5 * len(mixes)), squeeze=False)
+    for row, mix in enumerate(mixes):
+        series = defaultdict(list)
+        for r in runs:
+            if r["mix"] == mix:
+                series[r["container"]].append((int(r["size"]), float(r["mops_per_s"]), int(r["p99_ns"])))
+
+        for container, points in series.items():
+            points.sort()
+            ns = [n for (n, _, _) in points]
+            axes[row][0].plot(ns, [m for (_, m, _) in points], marker="o", label=container)
+            axes[row][1].plot(ns, [p for (_, _, p) in points], marker="o", label=container)
+
+        for col, title in enumerate(["Mops/s", "p99, ns"]):
+            ax = axes[row][col]
+            ax.set_xscale("log")
+            ax.set_title("%s: %s" % (mix, title))
+            ax.grid(True)
+        axes[row][0].legend(fontsize="small")
+
+    fig.tight_layout()
+    plt.savefig("plot.png")
+
+def compareRuns(runs, baseline):
+    base = byKey(baseline)
+    regressions = []
+    for key, r in sorted(byKey(runs).items()):
+        if key not in base:
+            continue
+        b = base[key]
+        mops, baseMops = float(r["mops_per_s"]), float(b["mops_per_s"])
+        p99, baseP99 = int(r["p99_ns"]), int(b["p99_ns"])
+        if mops < baseMops * (1 - THROUGHPUT_DROP) or p99 > baseP99 * (1 + P99_GROWTH):
+            regressions.append("%-12s %-8s %10d  %9.2f -> %9.2f Mops/s  %7d -> %7d ns p99"
+                               % (key + (baseMops, mops, baseP99, p99)))
+    for line in regressions:
+        print(line)
+    return not regressions
+
+if __name__ == "__main__":
+    runs = readRuns(sys.argv[1] if len(sys.argv) > 1 else "perf.csv")
+    ok = True
+    if len(sys.argv) > 2:
+        ok = compareRuns(runs, readRuns(sys.argv[2]))
+    plotRuns(runs)
+    sys.exit(0 if ok else 1)
@@ -0,0 +1,352 @@
+#pragma once
+#ifndef RING_BUFFER_STORAGE_H_INCLUDED
+#define RING_BUFFER_STORAGE_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <type_traits>
+
+#include "deque_segment.h"
+
+
+// What a push into a full ring does.
+enum class RingOverflow {
+    Reject,    // nothing is stored, push returns false
+    Overwrite, // the element at the opposite end is dropped to make room
+    Grow       // the buffer is doubled (run-time capacity only)
+};
+
+template <size_t Capacity, RingOverflow Overflow> struct RingBufferLayout;
+
+
+// Slots of a ring. With a compile-time Capacity they live inside the
+// object itself, so such a ring never allocates.
+template <typename T, typename Allocator, size_t Capacity>
+class RingSlots {
+    static_assert((Capacity & (Capacity - 1)) == 0, "ring capacity must be a power of two");
+
+private:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type slots_[Capacity];
+
+public:
+    RingSlots() {}
+    RingSlots(const RingSlots&) = delete;
+    RingSlots& operator=(const RingSlots&) = delete;
+
+    T* data() const {return reinterpret_cast<T*>(const_cast<RingSlots*>(this)->slots_);}
+    size_t capacity() const {return Capacity;}
+
+    void reset(Allocator&, size_t capacity) {assert(capacity == Capacity); (void)capacity;}
+    void release(Allocator&) {}
+
+    // elements have to be moved one by one
+    bool steal(RingSlots&) {return false;}
+};
+
+// Run-time capacity: one buffer from the allocator, taken at construction
+// and replaced only when a Grow ring overflows.
+template <typename T, typename Allocator>
+class RingSlots<T, Allocator, 0> {
+private:
+    T *data_;
+    size_t capacity_;
+
+public:
+    RingSlots(): data_(nullptr), capacity_(0) {}
+    RingSlots(const RingSlots&) = delete;
+    RingSlots& operator=(const RingSlots&) = delete;
+
+    T* data() const {return data_;}
+    size_t capacity() const {return capacity_;}
+
+    void reset(Allocator &alloc, size_t capacity) {
+        release(alloc);
+        data_ = alloc.allocate(capacity);
+        capacity_ = capacity;
+    }
+
+    void release(Allocator &alloc) {
+        if (data_ != nullptr)
+            alloc.deallocate(data_, capacity_);
+        data_ = nullptr;
+        capacity_ = 0;
+    }
+
+    bool steal(RingSlots &other) {
+        std::swap(data_, other.data_);
+        std::swap(capacity_, other.capacity_);
+        return true;
+    }
+};
+
+
+// Circular buffer of power-of-two capacity: element i sits in slot
+// (head_ + i) & mask, so both ends are a single masked store and no
+// element is ever moved, except when a Grow ring doubles.
+template <typename T, typename Allocator, size_t Capacity, RingOverflow Overflow>
+class RingBufferStorage {
+    static_assert(!(Capacity > 0 && Overflow == RingOverflow::Grow),
+                  "a ring with compile-time capacity cannot grow");
+
+private:
+    typedef std::allocator_traits<Allocator> Traits;
+    typedef RingSlots<T, Allocator, Capacity> Slots;
+    typedef std::integral_constant<RingOverflow, Overflow> OverflowTag;
+    typedef std::integral_constant<RingOverflow, RingOverflow::Reject> RejectTag;
+    typedef std::integral_constant<RingOverflow, RingOverflow::Overwrite> OverwriteTag;
+    typedef std::integral_constant<RingOverflow, RingOverflow::Grow> GrowTag;
+
+    Allocator alloc_;
+    Slots slots_;
+    size_t head_;
+    size_t size_;
+
+    static size_t ceilPow2(size_t x) {
+        size_t p = 1;
+        while (p < x)
+            p *= 2;
+        return p;
+    }
+
+    T* slot(size_t i) const {return slots_.data() + ((head_ + i) & (slots_.capacity() - 1));}
+    bool full() const {return size_ == slots_.capacity();}
+
+    // *this must be empty
+    void moveFrom(RingBufferStorage &other) {
+        if (slots_.steal(other.slots_)) {
+            std::swap(head_, other.head_);
+            std::swap(size_, other.size_);
+            return;
+        }
+        for (size_t i = 0; i < other.size_; i++)
+            Traits::construct(alloc_, slot(i), std::move(*other.slot(i)));
+        size_ = other.size_;
+        other.clear();
+    }
+
+    void clear() {
+        erase_back(size_);
+        head_ = 0;
+    }
+
+    template <typename... Args>
+    bool overflow_back(RejectTag, Args&&...) {return false;}
+
+    template <typename... Args>
+    bool overflow_front(RejectTag, Args&&...) {return false;}
+
+    // args may refer to the element being dropped
+    template <typename... Args>
+    bool overflow_back(OverwriteTag, Args&&... args) {
+        if (slots_.capacity() == 0)
+            return false;
+        T val(std::forward<Args>(args)...);
+        pop_front();
+        Traits::construct(alloc_, slot(size_), std::move(val));
+        size_++;
+        return true;
+    }
+
+    template <typename... Args>
+    bool overflow_front(OverwriteTag, Args&&... args) {
+        if (slots_.capacity() == 0)
+            return false;
+        T val(std::forward<Args>(args)...);
+        pop_back();
+        head_ = (head_ - 1) & (slots_.capacity() - 1);
+        Traits::construct(alloc_, slot(0), std::move(val));
+        size_++;
+        return true;
+    }
+
+    template <typename... Args>
+    bool overflow_back(GrowTag, Args&&... args) {
+        grow(false, std::forward<Args>(args)...);
+        return true;
+    }
+
+    template <typename... Args>
+    bool overflow_front(GrowTag, Args&&... args) {
+        grow(true, std::forward<Args>(args)...);
+        return true;
+    }
+
+    // The new element is constructed before the old ones are moved,
+    // as args may refer to one of them.
+    template <typename... Args>
+    void grow(bool atFront, Args&&... args) {
+        const size_t capacity = (slots_.capacity() > 0 ? slots_.capacity() * 2 : 1);
+        Slots bigger;
+        bigger.reset(alloc_, capacity);
+        Traits::construct(alloc_, bigger.data() + (atFront ? capacity - 1 : size_), std::forward<Args>(args)...);
+        for (size_t i = 0; i < size_; i++) {
+            T *from = slot(i);
+            Traits::construct(alloc_, bigger.data() + i, std::move(*from));
+            Traits::destroy(alloc_, from);
+        }
+        slots_.release(alloc_);
+        slots_.steal(bigger);
+        head_ = (atFront ? capacity - 1 : 0);
+        size_++;
+    }
+
+public:
+    RingBufferStorage(const RingBufferLayout<Capacity, Overflow> &layout, const Allocator &alloc):
+            alloc_(alloc), slots_(), head_(0), size_(0) {
+        slots_.reset(alloc_, ceilPow2(layout.capacity));
+    }
+
+    RingBufferStorage(const RingBufferStorage &other):
+            alloc_(Traits::select_on_container_copy_construction(other.alloc_)), slots_(), head_(0), size_(0) {
+        slots_.reset(alloc_, other.slots_.capacity());
+        for (; size_ < other.size_; size_++)
+            Traits::construct(alloc_, slot(size_), *other.slot(size_));
+    }
+
+    RingBufferStorage(RingBufferStorage &&other): alloc_(other.alloc_), slots_(), head_(0), size_(0) {
+        moveFrom(other);
+    }
+
+    RingBufferStorage& operator=(const RingBufferStorage &other) {
+        if (this != &other) {
+            RingBufferStorage copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    RingBufferStorage& operator=(RingBufferStorage &&other) {
+        if (this != &other) {
+            clear();
+            slots_.release(alloc_);
+            alloc_ = other.alloc_;
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~RingBufferStorage() {
+        clear();
+        slots_.release(alloc_);
+    }
+
+    const T& front() const {assert(!empty()); return *slot(0);}
+    const T& back()  const {assert(!empty()); return *slot(size_ - 1);}
+    const T& operator[](size_t i) const {return *slot(i);}
+
+    bool empty() const {return size_ == 0;}
+    size_t size() const {return size_;}
+    size_t capacity() const {return slots_.capacity();}
+
+    // at most two runs: up to the end of the buffer, then from its start
+    DequeSegment<const T> segment(size_t i) const {
+        const size_t to_wrap = slots_.capacity() - head_;
+        if (i < to_wrap) {
+            DequeSegment<const T> seg = {slot(0), 1, 0, (size_ < to_wrap ? size_ : to_wrap)};
+            return seg;
+        }
+        DequeSegment<const T> seg = {slots_.data(), 1, to_wrap, size_};
+        return seg;
+    }
+
+    // Return false if the element was rejected (RingOverflow::Reject only).
+    template <typename... Args>
+    bool emplace_back(Args&&... args) {
+        if (full())
+            return overflow_back(OverflowTag(), std::forward<Args>(args)...);
+        Traits::construct(alloc_, slot(size_), std::forward<Args>(args)...);
+        size_++;
+        return true;
+    }
+
+    template <typename... Args>
+    bool emplace_front(Args&&... args) {
+        if (full())
+            return overflow_front(OverflowTag(), std::forward<Args>(args)...);
+        const size_t head = (head_ - 1) & (slots_.capacity() - 1);
+        Traits::construct(alloc_, slots_.data() + head, std::forward<Args>(args)...);
+        head_ = head;
+        size_++;
+        return true;
+    }
+
+    // element by element, each one subject to the overflow policy
+    template <typename BidirIt>
+    void append(BidirIt first, BidirIt last) {
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+
+    template <typename BidirIt>
+    void prepend(BidirIt first, BidirIt last) {
+        while (first != last)
+            emplace_front(*--last);
+    }
+
+    void pop_back() {
+        assert(!empty());
+        Traits::destroy(alloc_, slot(size_ - 1));
+        size_--;
+    }
+
+    void pop_front() {
+        assert(!empty());
+        Traits::destroy(alloc_, slot(0));
+        head_ = (head_ + 1) & (slots_.capacity() - 1);
+        size_--;
+    }
+
+    void erase_back(size_t count) {
+        assert(count <= size());
+        while (count-- > 0)
+            pop_back();
+    }
+
+    void erase_front(size_t count) {
+        assert(count <= size());
+        while (count-- > 0)
+            pop_front();
+    }
+
+    // Element by element, each one subject to the overflow policy;
+    // other is left empty either way.
+    void splice_back(RingBufferStorage &other) {
+        for (size_t i = 0; i < other.size_; i++)
+            emplace_back(std::move(*other.slot(i)));
+        other.clear();
+    }
+
+    void splice_front(RingBufferStorage &other) {
+        for (size_t i = other.size_; i > 0; i--)
+            emplace_front(std::move(*other.slot(i - 1)));
+        other.clear();
+    }
+
+    // Returns [i, size()) in a ring of the same capacity.
+    RingBufferStorage split(size_t i) {
+        assert(i <= size());
+        RingBufferStorage tail(RingBufferLayout<Capacity, Overflow>(slots_.capacity()), alloc_);
+        for (size_t k = i; k < size_; k++)
+            tail.emplace_back(std::move(*slot(k)));
+        erase_back(size_ - i);
+        return tail;
+    }
+};
+
+// Capacity > 0 fixes the capacity at compile time and keeps the elements
+// inline; Capacity == 0 takes it from the layout object at construction:
+//   Deque<int, RingBufferLayout<>> d(RingBufferLayout<>(1000)); // 1024 slots
+// Run-time capacities are rounded up to a power of two.
+template <size_t Capacity = 0, RingOverflow Overflow = RingOverflow::Reject>
+struct RingBufferLayout {
+    size_t capacity;
+
+    explicit RingBufferLayout(size_t capacity = (Capacity > 0 ? Capacity : 16)): capacity(capacity) {}
+
+    template <typename T, typename Allocator>
+    using storage = RingBufferStorage<T, Allocator, Capacity, Overflow>;
+};
+
+#endif // #ifndef RING_BUFFER_STORAGE_H_INCLUDED
@@ -0,0 +1,324 @@
+#pragma once
+#ifndef SPILL_STORAGE_H_INCLUDED
+#define SPILL_STORAGE_H_INCLUDED
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "deque_segment.h"
+
+
+template <typename T, typename Allocator> class SpillStorage;
+
+// Deque<T, SpillLayout> keeps about hotBytes of elements in memory, at both
+// ends; the rest goes to files in directory (see SpillStorage). The
+// directory must be on disk: on tmpfs, which /tmp often is, spilled
+// segments stay in RAM. The default, /var/tmp, is on disk on most systems.
+struct SpillLayout {
+    std::string directory;
+    size_t hotBytes;
+    size_t segmentBytes;
+
+    explicit SpillLayout(const std::string &directory = "/var/tmp",
+                         size_t hotBytes = static_cast<size_t>(64) << 20,
+                         size_t segmentBytes = static_cast<size_t>(1) << 20):
+        directory(directory), hotBytes(hotBytes), segmentBytes(segmentBytes) {}
+
+    template <typename T, typename Allocator>
+    using storage = SpillStorage<T, Allocator>;
+};
+
+
+// Storage for queues that may outgrow memory; T must be trivially copyable.
+//
+// Elements live in segments of a power-of-two number of elements,
+// addressed by absolute position as in BlockMapStorage. Segments come from
+// Allocator, but only hotBytes / segmentBytes of them - the ones nearest
+// to the two ends - stay there: a segment that falls out of that window is
+// written to its own (already unlinked) file in the spill directory and
+// mapped back, so the kernel can page it out. Elements of such a cold
+// segment are still reached through the mapping, just at page-fault speed.
+//
+// A segment is spilled at most once, when a new one is started at an end,
+// so pushes are amortized O(1) and pops never write to disk. I/O errors
+// are thrown as std::system_error.
+//
+// Every spilled segment is a mapping of its own, and the kernel caps the
+// mappings of a process (vm.max_map_count, 65530 by default): with 1 MB
+// segments that is some 64 GB of spill, and beyond it mmap fails with
+// ENOMEM. Larger spills need a larger segmentBytes.
+template <typename T, typename Allocator>
+class SpillStorage {
+    static_assert(std::is_trivially_copyable<T>::value, "spilled elements are copied as bytes");
+
+private:
+    static const size_t kMiddle = ~static_cast<size_t>(0) / 2 + 1;
+
+    typedef std::allocator_traits<Allocator> Traits;
+
+    struct Segment {
+        T *data;
+        bool spilled; // data is a file mapping
+    };
+
+    Allocator alloc_;
+    SpillLayout layout_;
+    size_t shift_;                  // a segment holds 1 << shift_ elements
+    size_t window_;                 // hot segments at each end
+    std::deque<Segment> segments_;  // segments_[0] holds position first_
+    size_t first_;
+    size_t size_;
+    T *spare_;                      // last released in-memory segment
+
+    size_t segmentSize() const {return static_cast<size_t>(1) << shift_;}
+    size_t segmentMask() const {return segmentSize() - 1;}
+    size_t segmentBytes() const {return segmentSize() * sizeof(T);}
+
+    T* slot(size_t pos) const {
+        return segments_[(pos >> shift_) - (first_ >> shift_)].data + (pos & segmentMask());
+    }
+
+    static std::system_error ioError(int err, const std::string &what) {
+        return std::system_error(err, std::generic_category(), what);
+    }
+
+    void spill(Segment &seg) {
+        std::string path = layout_.directory + "/deque-spill-XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        int fd = mkstemp(name.data());
+        if (fd < 0)
+            throw ioError(errno, "cannot create a spill file in " + layout_.directory);
+        unlink(name.data()); // gone with the last mapping
+
+        const char *bytes = reinterpret_cast<const char*>(seg.data);
+        for (size_t done = 0; done < segmentBytes(); ) {
+            ssize_t written = pwrite(fd, bytes + done, segmentBytes() - done, done);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0) {
+                int err = errno;
+                close(fd);
+                throw ioError(err, "cannot write a spill file");
+            }
+            done += static_cast<size_t>(written);
+        }
+
+        void *mapped = mmap(nullptr, segmentBytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        int err = errno;
+        close(fd);
+        if (mapped == MAP_FAILED)
+            throw ioError(err, "cannot map a spill file");
+
+        release(seg);
+        seg.data = static_cast<T*>(mapped);
+        seg.spilled = true;
+    }
+
+    void release(const Segment &seg) {
+        if (seg.spilled)
+            munmap(seg.data, segmentBytes());
+        else if (spare_ == nullptr)
+            spare_ = seg.data;
+        else
+            alloc_.deallocate(seg.data, segmentSize());
+    }
+
+    // The segment window_ away from this end leaves the hot window, unless
+    // it is still within the window of the other end. It is spilled before
+    // anything changes, so a failed spill leaves the storage as it was.
+    void addSegment(bool atFront) {
+        if (segments_.size() >= 2 * window_) {
+            Segment &cold = segments_[atFront ? window_ - 1 : segments_.size() - window_];
+            if (!cold.spilled)
+                spill(cold);
+        }
+        Segment seg = {(spare_ != nullptr ? spare_ : alloc_.allocate(segmentSize())), false};
+        spare_ = nullptr;
+        if (atFront)
+            segments_.push_front(seg);
+        else
+            segments_.push_back(seg);
+    }
+
+    void dropSegment(bool atFront) {
+        release(atFront ? segments_.front() : segments_.back());
+        if (atFront)
+            segments_.pop_front();
+        else
+            segments_.pop_back();
+    }
+
+    void clear() {
+        while (!segments_.empty())
+            dropSegment(false);
+        size_ = 0;
+    }
+
+    static size_t floorLog2(size_t x) {
+        size_t log = 0;
+        while ((x >> 1) >= (static_cast<size_t>(1) << log))
+            log++;
+        return log;
+    }
+
+public:
+    SpillStorage(const SpillLayout &layout, const Allocator &alloc):
+            alloc_(alloc), layout_(layout),
+            shift_(floorLog2(layout.segmentBytes / sizeof(T) > 0 ? layout.segmentBytes / sizeof(T) : 1)),
+            window_(0), segments_(), first_(0), size_(0), spare_(nullptr) {
+        size_t hot = layout.hotBytes / segmentBytes();
+        window_ = (hot / 2 > 0 ? hot / 2 : 1);
+        first_ = kMiddle + segmentSize() / 2;
+    }
+
+    SpillStorage(const SpillStorage &other):
+            SpillStorage(other.layout_, Traits::select_on_container_copy_construction(other.alloc_)) {
+        for (size_t i = 0; i < other.size_; i++)
+            emplace_back(other[i]);
+    }
+
+    SpillStorage(SpillStorage &&other): SpillStorage(other.layout_, other.alloc_) {
+        swap(other);
+    }
+
+    SpillStorage& operator=(SpillStorage other) {
+        swap(other);
+        return *this;
+    }
+
+    ~SpillStorage() {
+        clear();
+        if (spare_ != nullptr)
+            alloc_.deallocate(spare_, segmentSize());
+    }
+
+    void swap(SpillStorage &other) {
+        std::swap(alloc_, other.alloc_);
+        std::swap(layout_, other.layout_);
+        std::swap(shift_, other.shift_);
+        std::swap(window_, other.window_);
+        segments_.swap(other.segments_);
+        std::swap(first_, other.first_);
+        std::swap(size_, other.size_);
+        std::swap(spare_, other.spare_);
+    }
+
+    const T& front() const {assert(size_ > 0); return *slot(first_);}
+    const T& back()  const {assert(size_ > 0); return *slot(first_ + size_ - 1);}
+    const T& operator[](size_t i) const {return *slot(first_ + i);}
+
+    bool empty() const {return size_ == 0;}
+    size_t size() const {return size_;}
+
+    // the segment holding element i
+    DequeSegment<const T> segment(size_t i) const {
+        size_t offset = (first_ + i) & segmentMask();
+        size_t begin = i - std::min(offset, i);
+        size_t end = std::min(size_, i - offset + segmentSize());
+        DequeSegment<const T> seg = {slot(first_ + begin), 1, begin, end};
+        return seg;
+    }
+
+    // args may refer to an element that is about to be spilled
+    template <typename... Args>
+    void emplace_back(Args&&... args) {
+        T val(std::forward<Args>(args)...);
+        size_t pos = first_ + size_;
+        if (size_ == 0 || (pos & segmentMask()) == 0)
+            addSegment(false);
+        *slot(pos) = val;
+        size_++;
+    }
+
+    template <typename... Args>
+    void emplace_front(Args&&... args) {
+        T val(std::forward<Args>(args)...);
+        size_t pos = first_ - 1;
+        if (size_ == 0 || (pos & segmentMask()) == segmentMask())
+            addSegment(true);
+        first_ = pos;
+        *slot(pos) = val;
+        size_++;
+    }
+
+    template <typename BidirIt>
+    void append(BidirIt first, BidirIt last) {
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+
+    template <typename BidirIt>
+    void prepend(BidirIt first, BidirIt last) {
+        while (first != last)
+            emplace_front(*--last);
+    }
+
+    void pop_back() {
+        assert(size_ > 0);
+        size_t pos = first_ + size_ - 1;
+        size_--;
+        if (size_ == 0 || (pos & segmentMask()) == 0)
+            dropSegment(false);
+    }
+
+    void pop_front() {
+        assert(size_ > 0);
+        size_t pos = first_;
+        first_++;
+        size_--;
+        if (size_ == 0 || (pos & segmentMask()) == segmentMask())
+            dropSegment(true);
+    }
+
+    void erase_back(size_t count) {
+        assert(count <= size_);
+        while (count-- > 0)
+            pop_back();
+    }
+
+    void erase_front(size_t count) {
+        assert(count <= size_);
+        while (count-- > 0)
+            pop_front();
+    }
+
+    // element by element: segments of the two sides are placed differently
+    void splice_back(SpillStorage &other) {
+        for (size_t i = 0; i < other.size_; i++)
+            emplace_back(other[i]);
+        other.clear();
+    }
+
+    void splice_front(SpillStorage &other) {
+        for (size_t i = other.size_; i > 0; i--)
+            emplace_front(other[i - 1]);
+        other.clear();
+    }
+
+    // Returns [i, size()) in a storage with the same settings.
+    SpillStorage split(size_t i) {
+        assert(i <= size_);
+        SpillStorage tail(layout_, alloc_);
+        for (size_t k = i; k < size_; k++)
+            tail.emplace_back((*this)[k]);
+        erase_back(size_ - i);
+        return tail;
+    }
+};
+
+#endif // #ifndef SPILL_STORAGE_H_INCLUDED
@@ -2,22 +2,42 @@
 #include <string>
 #include <deque>
 #include <cstdlib>
-#include <chrono>
 #include <vector>
 #include <algorithm>
+#include <numeric>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <iterator>
+#include <atomic>
+#include <thread>
 
 #include <gtest/gtest.h>
 
 #include "deque.h"
+#include "buffer_pool.h"
+#include "work_stealing_deque.h"
+#include "monotonic_queue.h"
 
 
 // force compiler to compile all methods/etc.
 template class Deque<int>;
+template class Deque<int, BlockMapLayout<>>;
+template class Deque<int, DeamortizedSplitLayout>;
+template class Deque<int, SplitVectorLayout<ShrinkHysteresis<8, 2>, DequeStats>>;
+template class Deque<int, SplitVectorLayout<ShrinkHysteresis<8, 2>>, PoolAllocator<int>>;
+template class Deque<int, BlockMapLayout<>, PoolAllocator<int>>;
+template class Deque<int, DeamortizedSplitLayout, PoolAllocator<int>>;
+template class Deque<int, RingBufferLayout<1024>>;
+template class Deque<int, RingBufferLayout<0, RingOverflow::Overwrite>>;
+template class Deque<int, RingBufferLayout<0, RingOverflow::Grow>, PoolAllocator<int>>;
+template class Deque<int, SpillLayout>;
 
-template <typename T>
-bool compareDeques(const Deque<T> &d1, const std::deque<T> &d2) {
+template <typename DequeT, typename T>
+bool compareDeques(const DequeT &d1, const std::deque<T> &d2) {
     if (d1.empty() != d2.empty()) return false;
     if (d1.size() != d2.size()) return false;
+    if (d1.empty()) return true;
 
     if (d1.front() != d2.front()) return false;
     if (d1.back()  != d2.back())  return false;
@@ -42,16 +62,16 @@ bool compareIters(Iter1 it1, Iter1 end1, Iter2 it2, Iter2 end2) {
     return true;
 }
 
-template <typename T>
-bool compareDequesIters(Deque<T> &d1, std::deque<T> &d2) {
+template <typename DequeT, typename T>
+bool compareDequesIters(DequeT &d1, std::deque<T> &d2) {
     return (compareIters(d1.begin(),   d1.end(),   d2.begin(),   d2.end()) &&
             compareIters(d1.rbegin(),  d1.rend(),  d2.rbegin(),  d2.rend()) &&
             compareIters(d1.cbegin(),  d1.cend(),  d2.cbegin(),  d2.cend()) &&
             compareIters(d1.crbegin(), d1.crend(), d2.crbegin(), d2.crend()));
 }
 
-template <typename T>
-void applyRandomOp(Deque<T> &d1, std::deque<T> &d2, T valToPush) {
+template <typename DequeT, typename T>
+void applyRandomOp(DequeT &d1, std::deque<T> &d2, T valToPush) {
     if (!d2.empty() && rand() % 3 == 0) {
         if (rand() % 2) {
             d1.pop_back();
@@ -71,8 +91,32 @@ void applyRandomOp(Deque<T> &d1, std::deque<T> &d2, T valToPush) {
     }
 }
 
-TEST(DequeTest, PushPop) {
-    Deque<int> deque;
+// 256 ints per segment, two of them hot at each end: the typed tests go
+// through the spill files all the time
+struct TinySpillLayout : SpillLayout {
+    TinySpillLayout(): SpillLayout(::testing::TempDir(), 4096, 1024) {}
+};
+
+template <typename DequeT>
+class DequeTyped : public ::testing::Test {};
+
+typedef ::testing::Types<
+    Deque<int>,
+    Deque<int, BlockMapLayout<>>,
+    Deque<int, BlockMapLayout<8>>, // two ints per chunk - exercises chunk and map management
+    Deque<int, DeamortizedSplitLayout>,
+    Deque<int, SplitVectorLayout<ShrinkHysteresis<8, 2>>, PoolAllocator<int>>,
+    Deque<int, SplitVectorLayout<NeverShrink>>,
+    Deque<int, BlockMapLayout<8>, PoolAllocator<int>>,
+    Deque<int, DeamortizedSplitLayout, PoolAllocator<int>>,
+    Deque<int, RingBufferLayout<1 << 17>>, // never fills up in these tests
+    Deque<int, RingBufferLayout<0, RingOverflow::Grow>>,
+    Deque<int, TinySpillLayout>
+> DequeTypes;
+TYPED_TEST_SUITE(DequeTyped, DequeTypes);
+
+TYPED_TEST(DequeTyped, PushPop) {
+    TypeParam deque;
     std::deque<int> ref;
 
     for (int i = 0; i < 1000; i++) {
@@ -89,60 +133,698 @@ TEST(DequeTest, PushPop) {
     }
 }
 
-using std::chrono::steady_clock;
-using std::chrono::duration_cast;
-using std::chrono::nanoseconds;
-using std::chrono::milliseconds;
+template <typename DequeT>
+void fillRandom(DequeT &deque, std::deque<int> &ref, int count) {
+    for (int i = 0; i < count; i++)
+        applyRandomOp(deque, ref, rand() % 1000);
+}
 
-TEST(DequeTest, TimeComplexity) {
-    const int minMs = 200;
-    const int maxMs = 3000;
-    const size_t minCount = 10;
-    const double errorThres = 0.05;
+TYPED_TEST(DequeTyped, Segments) {
+    TypeParam deque;
+    std::deque<int> ref;
 
-    std::vector<double> constants;
-    for (int count = 1e2; count < 1e9; count *= 1.05) {
-        Deque<int> d;
-        auto start = steady_clock::now();
+    for (int round = 0; round < 50; round++) {
+        fillRandom(deque, ref, 500);
 
-        for (int i = 0; i < count; i++) {
-            if (!d.empty() && rand() % 3 == 0)
-                d.pop_front();
-            else
-                d.push_back(i);
+        size_t covered = 0;
+        const TypeParam &cdeque = deque;
+        for (const DequeSegment<const int> &seg : cdeque.segments()) {
+            ASSERT_EQ(seg.begin, covered);
+            ASSERT_GT(seg.end, seg.begin);
+            for (size_t i = 0; i < seg.size(); i++)
+                ASSERT_EQ(seg[i], ref[seg.begin + i]);
+            // data() is the lowest address of the run
+            ASSERT_EQ(seg.data()[seg.reversed() ? seg.size() - 1 : 0], ref[seg.begin]);
+            covered = seg.end;
         }
+        ASSERT_EQ(covered, ref.size());
+    }
+
+    for (DequeSegment<int> seg : deque.segments())
+        for (size_t i = 0; i < seg.size(); i++)
+            seg[i] = -seg[i];
+    for (size_t i = 0; i < ref.size(); i++)
+        ASSERT_EQ(deque[i], -ref[i]);
+}
+
+TYPED_TEST(DequeTyped, IteratorJumps) {
+    TypeParam deque;
+    std::deque<int> ref;
+    fillRandom(deque, ref, 20000);
+    ASSERT_FALSE(ref.empty());
+
+    typename TypeParam::iterator it = deque.begin();
+    std::deque<int>::iterator refIt = ref.begin();
+    for (int i = 0; i < 2000; i++) {
+        ptrdiff_t pos = refIt - ref.begin();
+        ptrdiff_t diff = rand() % ref.size() - pos;
+        it += diff;
+        refIt += diff;
+        ASSERT_EQ(it - deque.begin(), refIt - ref.begin());
+        ASSERT_EQ(*it, *refIt);
+        ASSERT_EQ(it[0], refIt[0]);
+        if (refIt != ref.begin()) {
+            ASSERT_EQ(*std::prev(it), *std::prev(refIt));
+        }
+    }
+}
+
+TYPED_TEST(DequeTyped, StdAlgorithms) {
+    TypeParam deque;
+    std::deque<int> ref;
+    fillRandom(deque, ref, 20000);
+
+    ASSERT_EQ(std::accumulate(deque.begin(), deque.end(), 0LL), std::accumulate(ref.begin(), ref.end(), 0LL));
+
+    std::sort(deque.begin(), deque.end());
+    std::sort(ref.begin(), ref.end());
+    ASSERT_TRUE(compareDequesIters(deque, ref));
 
-        auto finish = steady_clock::now();
-        auto elapsedNs = duration_cast<nanoseconds>(finish - start);
-        if (elapsedNs < milliseconds{minMs})
-            continue;
+    std::reverse(deque.begin(), deque.end());
+    std::reverse(ref.begin(), ref.end());
+    ASSERT_TRUE(compareDequesIters(deque, ref));
 
-        // TODO: find a better way to output results
-        //std::cerr << count << " " << elapsedNs.count() << std::endl;
+    std::vector<int> copied(deque.size());
+    std::copy(deque.cbegin(), deque.cend(), copied.begin());
+    ASSERT_TRUE(std::equal(copied.begin(), copied.end(), ref.begin()));
+}
+
+TYPED_TEST(DequeTyped, BulkOps) {
+    TypeParam deque;
+    std::deque<int> ref;
+    std::vector<int> out(300);
+
+    for (int round = 0; round < 300; round++) {
+        std::vector<int> batch(rand() % 200);
+        for (int &x : batch)
+            x = rand() % 1000;
+
+        switch (rand() % 7) {
+        case 0:
+            deque.append(batch.begin(), batch.end());
+            ref.insert(ref.end(), batch.begin(), batch.end());
+            break;
+        case 1:
+            deque.prepend(batch.begin(), batch.end());
+            ref.insert(ref.begin(), batch.begin(), batch.end());
+            break;
+        case 2: {
+            std::list<int> list(batch.begin(), batch.end());
+            deque.prepend(list.begin(), list.end());
+            ref.insert(ref.begin(), batch.begin(), batch.end());
+            break;
+        }
+        case 3: {
+            // single-pass input
+            std::ostringstream text;
+            for (int x : batch) text << x << " ";
+            std::istringstream in(text.str());
+            if (rand() % 2) {
+                deque.append(std::istream_iterator<int>(in), std::istream_iterator<int>());
+                ref.insert(ref.end(), batch.begin(), batch.end());
+            } else {
+                deque.prepend(std::istream_iterator<int>(in), std::istream_iterator<int>());
+                ref.insert(ref.begin(), batch.begin(), batch.end());
+            }
+            break;
+        }
+        case 4: {
+            size_t want = rand() % out.size();
+            size_t got = deque.pop_front_n(out.data(), want);
+            ASSERT_EQ(got, std::min(want, ref.size()));
+            for (size_t i = 0; i < got; i++) {
+                ASSERT_EQ(out[i], ref.front());
+                ref.pop_front();
+            }
+            break;
+        }
+        case 5: {
+            size_t want = rand() % out.size();
+            size_t got = deque.pop_back_n(out.data(), want);
+            ASSERT_EQ(got, std::min(want, ref.size()));
+            for (size_t i = 0; i < got; i++) {
+                ASSERT_EQ(out[i], ref.back());
+                ref.pop_back();
+            }
+            break;
+        }
+        default:
+            for (int x : batch) {
+                deque.emplace_front(x);
+                ref.push_front(x);
+            }
+        }
+        ASSERT_TRUE(compareDeques(deque, ref));
+    }
+}
+
+TYPED_TEST(DequeTyped, SpliceSplit) {
+    TypeParam deque;
+    std::deque<int> ref;
 
-        constants.push_back(elapsedNs.count() / count);
+    for (int round = 0; round < 300; round++) {
+        TypeParam other;
+        std::deque<int> otherRef;
+        fillRandom(other, otherRef, rand() % 1000);
 
-        if (elapsedNs > milliseconds{maxMs})
+        switch (rand() % 3) {
+        case 0:
+            deque.splice_back(std::move(other));
+            ref.insert(ref.end(), otherRef.begin(), otherRef.end());
+            ASSERT_TRUE(other.empty());
             break;
+        case 1:
+            deque.splice_front(std::move(other));
+            ref.insert(ref.begin(), otherRef.begin(), otherRef.end());
+            ASSERT_TRUE(other.empty());
+            break;
+        default: {
+            size_t at = rand() % (ref.size() + 1);
+            TypeParam tail = deque.split_at(at);
+            std::deque<int> refTail(ref.begin() + at, ref.end());
+            ref.erase(ref.begin() + at, ref.end());
+            ASSERT_TRUE(compareDeques(tail, refTail));
+
+            // both halves stay usable
+            applyRandomOp(tail, refTail, round);
+            ASSERT_TRUE(compareDequesIters(tail, refTail));
+        }
+        }
+        ASSERT_TRUE(compareDeques(deque, ref));
+        applyRandomOp(deque, ref, round);
+    }
+    ASSERT_TRUE(compareDequesIters(deque, ref));
+}
+
+template <typename Layout>
+void testMoveOnly() {
+    Deque<std::unique_ptr<int>, Layout> deque;
+    for (int i = 0; i < 1000; i++) {
+        deque.emplace_back(new int(i));
+        deque.push_front(std::unique_ptr<int>(new int(-i)));
+    }
+
+    std::vector<std::unique_ptr<int>> out(700);
+    ASSERT_EQ(deque.pop_front_n(out.data(), out.size()), out.size());
+    ASSERT_EQ(*out[0], -999);
+    ASSERT_EQ(*out[699], -300);
+    ASSERT_EQ(deque.pop_back_n(out.data(), out.size()), out.size());
+    ASSERT_EQ(*out[0], 999);
+    ASSERT_EQ(*out[699], 300);
+    ASSERT_EQ(deque.size(), 600u);
+    ASSERT_EQ(*deque.front(), -299);
+    ASSERT_EQ(*deque.back(), 299);
+
+    // rotate by half: [-299 .. -1, 0] [0, 1 .. 299]
+    Deque<std::unique_ptr<int>, Layout> tail = deque.split_at(300);
+    ASSERT_EQ(tail.size(), 300u);
+    deque.splice_front(std::move(tail));
+    ASSERT_EQ(deque.size(), 600u);
+    ASSERT_EQ(*deque[1], 1);
+    ASSERT_EQ(*deque[300], -299);
+    ASSERT_EQ(*deque.back(), 0);
+}
+
+TEST(DequeTest, MoveOnly) {
+    testMoveOnly<SplitVectorLayout<>>();
+    testMoveOnly<DeamortizedSplitLayout>();
+    testMoveOnly<BlockMapLayout<64>>();
+    testMoveOnly<RingBufferLayout<0, RingOverflow::Grow>>();
+}
+
+TYPED_TEST(DequeTyped, LongRandomWalk) {
+    TypeParam deque;
+    std::deque<int> ref;
+
+    for (int i = 0; i < 200000; i++) {
+        applyRandomOp(deque, ref, i);
+        if (i % 1000 == 0) {
+            ASSERT_TRUE(compareDeques(deque, ref));
+        }
+    }
+    ASSERT_TRUE(compareDeques(deque, ref));
+
+    while (!ref.empty()) {
+        ASSERT_EQ(deque.front(), ref.front());
+        deque.pop_front();
+        ref.pop_front();
+    }
+    ASSERT_TRUE(deque.empty());
+}
+
+template <typename DequeT>
+std::deque<int> toStd(const DequeT &deque) {
+    return std::deque<int>(deque.begin(), deque.end());
+}
+
+TEST(DequeTest, RingBufferReject) {
+    Deque<int, RingBufferLayout<4>> fixed;
+    for (int i = 0; i < 4; i++)
+        ASSERT_TRUE(i % 2 ? fixed.push_back(i) : fixed.push_front(i));
+    ASSERT_FALSE(fixed.push_back(4));
+    ASSERT_FALSE(fixed.emplace_front(5));
+    ASSERT_EQ(toStd(fixed), std::deque<int>({2, 0, 1, 3}));
+
+    fixed.pop_front();
+    ASSERT_TRUE(fixed.push_back(6));
+    ASSERT_EQ(toStd(fixed), std::deque<int>({0, 1, 3, 6}));
+
+    // run-time capacity is rounded up to a power of two
+    Deque<int, RingBufferLayout<>> sized(RingBufferLayout<>(5));
+    for (int i = 0; i < 8; i++)
+        ASSERT_TRUE(sized.push_back(i));
+    ASSERT_FALSE(sized.push_back(8));
+    ASSERT_EQ(sized.size(), 8u);
+}
+
+TEST(DequeTest, RingBufferOverwrite) {
+    Deque<int, RingBufferLayout<4, RingOverflow::Overwrite>> deque;
+    for (int i = 0; i < 6; i++)
+        ASSERT_TRUE(deque.push_back(i));
+    ASSERT_EQ(toStd(deque), std::deque<int>({2, 3, 4, 5}));
+
+    ASSERT_TRUE(deque.push_front(9));
+    ASSERT_EQ(toStd(deque), std::deque<int>({9, 2, 3, 4}));
+
+    // the pushed value is the one being overwritten
+    deque.push_back(deque.front());
+    ASSERT_EQ(toStd(deque), std::deque<int>({2, 3, 4, 9}));
+    deque.push_front(deque.back());
+    ASSERT_EQ(toStd(deque), std::deque<int>({9, 2, 3, 4}));
+
+    Deque<std::string, RingBufferLayout<0, RingOverflow::Overwrite>> strings(
+        RingBufferLayout<0, RingOverflow::Overwrite>(2));
+    for (int i = 0; i < 10; i++)
+        strings.push_front(std::to_string(i));
+    ASSERT_EQ(strings.front(), "9");
+    ASSERT_EQ(strings.back(), "8");
+}
+
+TEST(DequeTest, RingBufferGrow) {
+    typedef RingBufferLayout<0, RingOverflow::Grow> Layout;
+    Deque<std::string, Layout> deque((Layout(1)));
+    deque.push_back("a");
+    deque.push_back(deque.front());
+    deque.push_front(deque.back());
+    deque.push_front("b");
+    deque.push_back(deque.front());
+    ASSERT_EQ(deque.size(), 5u);
+    ASSERT_EQ(deque[0], "b");
+    ASSERT_EQ(deque[1], "a");
+    ASSERT_EQ(deque[4], "b");
+
+    Deque<std::string, Layout> copy(deque);
+    Deque<std::string, Layout> moved(std::move(deque));
+    ASSERT_EQ(moved.size(), 5u);
+    ASSERT_EQ(copy.back(), "b");
+    copy = moved;
+    moved.pop_back();
+    ASSERT_EQ(copy.size(), 5u);
+}
+
+// without stats the storage is just the two vectors
+static_assert(sizeof(Deque<int>) == 2 * sizeof(std::vector<int>), "NoStats must take no space");
+
+TEST(DequeTest, Stats) {
+    Deque<int, SplitVectorLayout<ShrinkToFit, DequeStats>> deque;
+    // libstdc++ doubles the capacity: 1, 2, 4, 8
+    for (int i = 0; i < 8; i++)
+        deque.push_back(i);
+    ASSERT_EQ(deque.stats().peakCapacity, 8u);
+
+    // empty front half: 4 of the 8 move over, the front half gets 4 slots
+    deque.pop_front();
+    DequeStats stats = deque.stats();
+    ASSERT_EQ(stats.rebalances, 1u);
+    ASSERT_EQ(stats.elementsMoved, 4u);
+    ASSERT_EQ(stats.shrinks, 0u);
+    ASSERT_EQ(stats.peakCapacity, 12u);
+
+    // the front half runs dry and is freed (0 * 4 < 4), the next pop
+    // moves 2 of the remaining 4 over
+    for (int i = 0; i < 4; i++)
+        deque.pop_front();
+    ASSERT_EQ(deque.stats().rebalances, 2u);
+    ASSERT_EQ(deque.stats().elementsMoved, 6u);
+    ASSERT_EQ(deque.stats().shrinks, 1u);
+
+    // front half freed again; back half 1 * 4 < 8 shrinks to 1, then 0 * 4 < 1
+    deque.pop_front();
+    deque.pop_back();
+    deque.pop_back();
+    ASSERT_TRUE(deque.empty());
+    ASSERT_EQ(deque.stats().shrinks, 4u);
+    ASSERT_EQ(deque.stats().peakCapacity, 12u);
+
+    // a snapshot is not affected by later operations
+    ASSERT_EQ(stats.rebalances, 1u);
+
+    deque.reset_stats();
+    ASSERT_EQ(deque.stats().rebalances, 0u);
+    ASSERT_EQ(deque.stats().elementsMoved, 0u);
+    ASSERT_EQ(deque.stats().shrinks, 0u);
+    ASSERT_EQ(deque.stats().peakCapacity, 0u);
+
+    // bulk erase rebalances like pop does
+    deque.push_back(1);
+    deque.push_back(2);
+    deque.push_back(3);
+    std::vector<int> out(1);
+    deque.pop_front_n(out.data(), 1);
+    ASSERT_EQ(deque.stats().rebalances, 1u);
+    ASSERT_EQ(deque.stats().elementsMoved, 1u);
+}
+
+TEST(DequeTest, BlockMapStableReferences) {
+    Deque<int, BlockMapLayout<16>> deque;
+    deque.push_back(0);
+    const int *first = &deque.front();
+
+    for (int i = 1; i < 100000; i++) {
+        deque.push_back(i);
+        deque.push_front(-i);
     }
+    ASSERT_EQ(first, &deque[99999]);
+    ASSERT_EQ(*first, 0);
+}
+
+TEST(DequeTest, BlockMapSpliceMovesChunks) {
+    Deque<int, BlockMapLayout<64>> deque;
+    for (int i = 0; i < 100000; i++)
+        deque.push_back(i);
+    const int *moved = &deque[50100];
+
+    // the tail keeps element 50000 at the same offset in its chunk,
+    // so everything past that chunk changes hands by pointer
+    Deque<int, BlockMapLayout<64>> tail = deque.split_at(50000);
+    ASSERT_EQ(&tail[100], moved);
+    ASSERT_EQ(deque.back(), 49999);
+
+    deque.splice_back(std::move(tail));
+    ASSERT_EQ(&deque[50100], moved);
+    for (int i = 0; i < 100000; i++)
+        ASSERT_EQ(deque[i], i);
+}
+
+TEST(DequeTest, BlockMapCopy) {
+    Deque<std::string, BlockMapLayout<64>> deque;
+    for (int i = 0; i < 1000; i++)
+        deque.push_front(std::to_string(i));
+
+    Deque<std::string, BlockMapLayout<64>> copy(deque);
+    deque.pop_back();
+    ASSERT_EQ(copy.size(), 1000u);
+    ASSERT_EQ(copy.back(), "0");
+    ASSERT_EQ(copy.front(), "999");
+
+    copy = std::move(deque);
+    ASSERT_EQ(copy.size(), 999u);
+    ASSERT_EQ(copy.back(), "1");
+}
+
+// counts what a deque holds from its allocator
+struct AllocationMeter {
+    size_t live;
+    size_t peak;
+
+    AllocationMeter(): live(0), peak(0) {}
+};
+
+template <typename T>
+struct MeteredAllocator {
+    typedef T value_type;
 
-    if (constants.size() <= minCount) {
-        FAIL() << "Not enough time measurements - less than " << minCount
-               << " in [" << minMs << "ms, " << maxMs << "ms] interval";
-        return;
+    AllocationMeter *meter;
+
+    explicit MeteredAllocator(AllocationMeter &meter): meter(&meter) {}
+    template <typename U>
+    MeteredAllocator(const MeteredAllocator<U> &other): meter(other.meter) {}
+
+    T* allocate(size_t n) {
+        meter->live += n * sizeof(T);
+        meter->peak = std::max(meter->peak, meter->live);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T *p, size_t n) {
+        meter->live -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    bool operator==(const MeteredAllocator &other) const {return meter == other.meter;}
+    bool operator!=(const MeteredAllocator &other) const {return meter != other.meter;}
+};
+
+TEST(DequeTest, SpillBeyondMemoryCap) {
+    const size_t hotBytes = 256 << 10;
+    const size_t segmentBytes = 64 << 10;
+    AllocationMeter meter;
+    Deque<int, SpillLayout, MeteredAllocator<int>> deque(
+        SpillLayout(::testing::TempDir(), hotBytes, segmentBytes), MeteredAllocator<int>(meter));
+    std::deque<int> expected;
+
+    // 16 MiB of ints, 64 times the cap, mostly pushed at the back
+    srand(12);
+    for (int i = 0; i < (4 << 20); i++) {
+        int r = rand();
+        if (!expected.empty() && r % 8 == 0) {
+            deque.pop_front();
+            expected.pop_front();
+        } else if (!expected.empty() && r % 8 == 1) {
+            deque.pop_back();
+            expected.pop_back();
+        } else if (r % 8 == 2) {
+            deque.push_front(i);
+            expected.push_front(i);
+        } else {
+            deque.push_back(i);
+            expected.push_back(i);
+        }
     }
+    ASSERT_LE(meter.peak, hotBytes + 2 * segmentBytes);
+
+    auto checkSample = [&]() {
+        ASSERT_EQ(deque.size(), expected.size());
+        ASSERT_EQ(deque.front(), expected.front());
+        ASSERT_EQ(deque.back(), expected.back());
+        for (int k = 0; k < 10000; k++) {
+            size_t i = static_cast<size_t>(rand()) % expected.size();
+            ASSERT_EQ(deque[i], expected[i]);
+        }
+    };
+    checkSample();
+
+    // writes through the cold segments stick
+    for (size_t i = 0; i < expected.size(); i += 1000) {
+        deque[i] = -1;
+        expected[i] = -1;
+    }
+    checkSample();
+
+    // both ends are popped deep into what was spilled
+    for (size_t i = 0; i < expected.size() / 3; i++) {
+        ASSERT_EQ(deque.front(), expected.front());
+        ASSERT_EQ(deque.back(), expected.back());
+        deque.pop_front();
+        expected.pop_front();
+        deque.pop_back();
+        expected.pop_back();
+    }
+    checkSample();
+    ASSERT_LE(meter.peak, hotBytes + 2 * segmentBytes);
+}
+
+template <typename Layout>
+size_t oscillateAndCache(BufferPool &pool) {
+    Deque<int, Layout, PoolAllocator<int>> deque((PoolAllocator<int>(pool)));
+    for (int cycle = 0; cycle < 10; cycle++) {
+        while (deque.size() < 5000)
+            deque.push_back(cycle);
+        while (deque.size() > 100)
+            deque.pop_front();
+    }
+    return pool.cachedBytes();
+}
 
-    double midC = 0;
-    for (double c : constants) midC += c;
-    midC /= constants.size();
+template <typename Layout>
+void testPoolRecycles() {
+    BufferPool pool;
+    oscillateAndCache<Layout>(pool);
+    size_t cached = pool.cachedBytes();
+    ASSERT_GT(cached, 0u);
 
-    for (double c : constants) {
-        double relError = std::abs(c - midC) / std::abs((c + midC) / 2);
-        if (relError > errorThres) {
-            FAIL() << "constant's relative error ( = " << relError << ") should be <= " << errorThres;
-            return;
+    // an identical second run is served from the pool and gives everything back
+    oscillateAndCache<Layout>(pool);
+    ASSERT_EQ(pool.cachedBytes(), cached);
+}
+
+TEST(DequeTest, PoolRecyclesBuffers) {
+    testPoolRecycles<SplitVectorLayout<>>();
+    testPoolRecycles<SplitVectorLayout<ShrinkHysteresis<8, 2>>>();
+    testPoolRecycles<DeamortizedSplitLayout>();
+    testPoolRecycles<BlockMapLayout<>>();
+}
+
+TEST(DequeTest, BufferPoolLimit) {
+    BufferPool pool(64);
+    PoolAllocator<int> alloc(pool);
+    int *a = alloc.allocate(16); // 64 bytes
+    int *b = alloc.allocate(16);
+    alloc.deallocate(a, 16);
+    alloc.deallocate(b, 16); // over the limit - goes back to the heap
+    ASSERT_EQ(pool.cachedBytes(), 64u);
+    ASSERT_EQ(alloc.allocate(13), a); // same size class
+    alloc.deallocate(a, 13);
+}
+
+TEST(MonotonicQueueTest, AgainstBruteForce) {
+    MonotonicQueue<int> queue;
+    std::deque<int> ref;
+
+    for (int i = 0; i < 100000; i++) {
+        // mostly small windows, sometimes drained
+        if (!ref.empty() && rand() % (ref.size() > 50 ? 2 : 3) == 0) {
+            queue.pop();
+            ref.pop_front();
+        } else {
+            int val = rand() % 100;
+            queue.push(val);
+            ref.push_back(val);
+        }
+
+        ASSERT_EQ(queue.size(), ref.size());
+        if (!ref.empty()) {
+            ASSERT_EQ(queue.min(), *std::min_element(ref.begin(), ref.end()));
+            ASSERT_EQ(queue.max(), *std::max_element(ref.begin(), ref.end()));
+        }
+    }
+}
+
+TEST(MonotonicQueueTest, Compare) {
+    MonotonicQueue<std::string, std::greater<std::string>> queue;
+    queue.push("b");
+    queue.push("c");
+    queue.push("a");
+    ASSERT_EQ(queue.min(), "c");
+    ASSERT_EQ(queue.max(), "a");
+    queue.pop();
+    queue.pop();
+    ASSERT_EQ(queue.min(), "a");
+    ASSERT_EQ(queue.max(), "a");
+}
+
+TEST(MonotonicQueueTest, WindowMinima) {
+    std::vector<int> input(2000);
+    for (int &x : input)
+        x = rand() % 50;
+
+    for (size_t width : {1, 2, 3, 17, 1000, 2000, 2001}) {
+        std::vector<int> minima, maxima;
+        windowMinima(input.begin(), input.end(), width, std::back_inserter(minima));
+        windowMinima(input.begin(), input.end(), width, std::back_inserter(maxima), std::greater<int>());
+
+        size_t windows = (width <= input.size() ? input.size() - width + 1 : 0);
+        ASSERT_EQ(minima.size(), windows);
+        ASSERT_EQ(maxima.size(), windows);
+        for (size_t i = 0; i < windows; i++) {
+            ASSERT_EQ(minima[i], *std::min_element(input.begin() + i, input.begin() + i + width));
+            ASSERT_EQ(maxima[i], *std::max_element(input.begin() + i, input.begin() + i + width));
+        }
+    }
+}
+
+TEST(WorkStealingDequeTest, SingleThread) {
+    WorkStealingDeque<int> deque(1);
+    int val = -1;
+    ASSERT_FALSE(deque.pop_back(val));
+    ASSERT_FALSE(deque.steal(val));
+
+    for (int i = 0; i < 100; i++)
+        deque.push_back(i);
+    ASSERT_EQ(deque.size(), 100u);
+
+    ASSERT_TRUE(deque.steal(val));
+    ASSERT_EQ(val, 0);
+    ASSERT_TRUE(deque.pop_back(val));
+    ASSERT_EQ(val, 99);
+
+    for (int i = 1; i < 99; i++) {
+        ASSERT_TRUE(deque.steal(val));
+        ASSERT_EQ(val, i);
+    }
+    ASSERT_TRUE(deque.empty());
+    ASSERT_FALSE(deque.pop_back(val));
+}
+
+TEST(WorkStealingDequeTest, EveryElementOnce) {
+    const int count = 1000000;
+    const int thievesCnt = 3;
+
+    WorkStealingDeque<int> deque(2);
+    std::vector<std::atomic<int>> taken(count);
+    std::atomic<bool> ownerDone(false);
+
+    std::vector<std::thread> thieves;
+    for (int i = 0; i < thievesCnt; i++) {
+        thieves.emplace_back([&]() {
+            int val;
+            while (!ownerDone.load() || !deque.empty())
+                if (deque.steal(val))
+                    taken[val]++;
+        });
+    }
+
+    int val;
+    for (int i = 0; i < count; i++) {
+        deque.push_back(i);
+        if (i % 3 == 0 && deque.pop_back(val))
+            taken[val]++;
+    }
+    while (deque.pop_back(val))
+        taken[val]++;
+    ownerDone = true;
+
+    for (std::thread &thief : thieves)
+        thief.join();
+
+    for (int i = 0; i < count; i++)
+        ASSERT_EQ(taken[i].load(), 1) << "element " << i;
+}
+
+// The latency bound of DeamortizedSplitLayout, counted rather than timed
+// (perf_deque times it; wall-clock maxima are at the mercy of page faults):
+// on a deque growing to over half a million elements under all four
+// operations, no single one moves more than 2 elements (the migration step)
+// between buffers.
+TEST(DequeTest, DeamortizedMovesPerOperation) {
+    typedef DeamortizedSplitStorage<int, std::allocator<int>> Storage;
+    Storage storage{DeamortizedSplitLayout(), std::allocator<int>()};
+    const size_t maxMoved = 2;
+
+    srand(42);
+    size_t moved = 0;
+    size_t expectedSize = 0;
+    for (int i = 0; i < 3000000; i++) {
+        int op = rand() % 5;
+        if (storage.empty() || op <= 1) {
+            storage.emplace_back(i);
+            expectedSize++;
+        } else if (op == 2) {
+            storage.emplace_front(i);
+            expectedSize++;
+        } else if (op == 3) {
+            storage.pop_front();
+            expectedSize--;
+        } else {
+            // with the back half empty this pops the far end of the front
+            storage.pop_back();
+            expectedSize--;
         }
+        ASSERT_LE(storage.moved() - moved, maxMoved) << "operation " << i;
+        moved = storage.moved();
     }
+    ASSERT_EQ(storage.size(), expectedSize);
+    ASSERT_GT(moved, expectedSize); // migrations did happen
 }
 
 int main(int argc, char **argv) {
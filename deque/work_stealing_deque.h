@@ -0,0 +1,161 @@
+#pragma once
+#ifndef WORK_STEALING_DEQUE_H_INCLUDED
+#define WORK_STEALING_DEQUE_H_INCLUDED
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+
+// Lock-free Chase-Lev work-stealing deque
+// (memory orderings follow Le, Pop, Cohen, Zappa Nardelli, PPoPP'13).
+//
+// Only the owner thread may call push_back/pop_back; steal() takes from the
+// front and may be called from any thread. Elements are copied in and out
+// of atomic slots, so T must be trivially copyable (task pointers, indices).
+//
+// Thieves may still be reading a buffer after the owner has replaced it
+// with a bigger one, so replaced buffers are retired rather than freed and
+// are released together with the deque. Capacities double, so retired
+// buffers never take more memory than the current one.
+template <typename T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "WorkStealingDeque elements are copied through atomics");
+
+private:
+    class Buffer {
+    private:
+        const int64_t mask_;
+        std::atomic<T> *slots_;
+
+    public:
+        explicit Buffer(int64_t capacity): mask_(capacity - 1), slots_(new std::atomic<T>[capacity]) {
+            assert(capacity > 0 && (capacity & mask_) == 0);
+        }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        ~Buffer() {delete[] slots_;}
+
+        int64_t capacity() const {return mask_ + 1;}
+
+        T get(int64_t i) const {return slots_[i & mask_].load(std::memory_order_relaxed);}
+        void put(int64_t i, T val) {slots_[i & mask_].store(val, std::memory_order_relaxed);}
+
+        Buffer* grow(int64_t top, int64_t bottom) const {
+            Buffer *bigger = new Buffer(capacity() * 2);
+            for (int64_t i = top; i < bottom; i++)
+                bigger->put(i, get(i));
+            return bigger;
+        }
+    };
+
+    static const size_t kCacheLine = 64;
+
+    static int64_t ceilPow2(size_t x) {
+        int64_t p = 1;
+        while (static_cast<size_t>(p) < x)
+            p *= 2;
+        return p;
+    }
+
+    // top_ and bottom_ sit on separate cache lines: thieves hammer the former,
+    // the owner - the latter
+    std::atomic<int64_t> top_;
+    char padTop_[kCacheLine - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom_;
+    char padBottom_[kCacheLine - sizeof(std::atomic<int64_t>)];
+    std::atomic<Buffer*> buffer_;
+    std::vector<Buffer*> retired_; // owner-only
+
+public:
+    explicit WorkStealingDeque(size_t capacity = 64):
+        top_(0), padTop_(), bottom_(0), padBottom_(), buffer_(new Buffer(ceilPow2(capacity))), retired_() {}
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    ~WorkStealingDeque() {
+        delete buffer_.load(std::memory_order_relaxed);
+        for (Buffer *buf : retired_)
+            delete buf;
+    }
+
+    // Approximate when called concurrently with other operations.
+    size_t size() const {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        return static_cast<size_t>(b > t ? b - t : 0);
+    }
+
+    bool empty() const {return size() == 0;}
+
+    // Owner only.
+    void push_back(T val) {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Buffer *buf = buffer_.load(std::memory_order_relaxed);
+
+        if (b - t > buf->capacity() - 1) {
+            retired_.push_back(buf);
+            buf = buf->grow(t, b);
+            buffer_.store(buf, std::memory_order_release);
+        }
+
+        buf->put(b, val);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only. Returns false if the deque is empty.
+    bool pop_back(T &out) {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Buffer *buf = buffer_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        T val = buf->get(b);
+        if (t == b) {
+            // last element - race against thieves for it
+            bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                              std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            if (!won)
+                return false;
+        }
+        out = val;
+        return true;
+    }
+
+    // Any thread. Returns false if the deque is empty or another thread
+    // won the race for the front element.
+    bool steal(T &out) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+
+        if (t >= b)
+            return false;
+
+        Buffer *buf = buffer_.load(std::memory_order_acquire);
+        T val = buf->get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                                    std::memory_order_relaxed))
+            return false;
+        out = val;
+        return true;
+    }
+};
+
+#endif // #ifndef WORK_STEALING_DEQUE_H_INCLUDED
@@ -0,0 +1,1033 @@
+#include <iostream>
+#include <algorithm>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <utility>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <new>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <type_traits>
+
+#include "heap.h"
+#include "stupid_heap.h"
+#include "binomial_heap.h"
+#include "lazy_binomial_heap.h"
+#include "leftist_heap.h"
+#include "skew_heap.h"
+#include "dary_heap.h"
+#include "pairing_heap.h"
+#include "fibonacci_heap.h"
+#include "multi_queue.h"
+#include "persistent_leftist_heap.h"
+#include "persistent_skew_heap.h"
+#include "radix_heap.h"
+#include "external_heap.h"
+#include "loser_tree.h"
+#include "heap_forest.h"
+
+
+using std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::duration;
+
+
+// Every heap allocation in this binary goes through here, the array and
+// sized forms included. operator delete stays out of line: inlined, gcc
+// would see free() taking a pointer from operator new and warn
+// (-Wmismatched-new-delete). A header in front of each block keeps its size
+// for liveBytes.
+static std::atomic<size_t> newCalls(0);
+static std::atomic<size_t> liveBytes(0);
+static const size_t kNewHeader = alignof(std::max_align_t);
+
+void* operator new(size_t bytes) {
+    newCalls.fetch_add(1, std::memory_order_relaxed);
+    if (char *ptr = static_cast<char*>(std::malloc(kNewHeader + bytes))) {
+        *reinterpret_cast<size_t*>(ptr) = bytes;
+        liveBytes.fetch_add(bytes, std::memory_order_relaxed);
+        return ptr + kNewHeader;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept {
+    if (ptr == nullptr)
+        return;
+    char *block = static_cast<char*>(ptr) - kNewHeader;
+    liveBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+void* operator new[](size_t bytes) {
+    return operator new(bytes);
+}
+
+void operator delete[](void *ptr) noexcept {
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+
+template <typename Func>
+double timeMs(Func func) {
+    auto start = steady_clock::now();
+    func();
+    return duration_cast<duration<double, std::milli>>(steady_clock::now() - start).count();
+}
+
+// Keeps the compiler from throwing a computed result away.
+static volatile long long sink;
+
+
+// Scheduler-like hold model: the heap stays at `size` keys, and every
+// operation takes the minimum out and puts a later key back.
+template <typename HeapT>
+double benchHold(size_t size, size_t ops) {
+    std::minstd_rand rng(1);
+    HeapT heap;
+    for (size_t i = 0; i < size; i++)
+        heap.insert(static_cast<int>(rng() % 1000000));
+    return timeMs([&]() {
+        long long sum = 0;
+        for (size_t i = 0; i < ops; i++) {
+            int key = heap.getMin();
+            heap.extractMin();
+            heap.insert(key + static_cast<int>(rng() % 1000));
+            sum += key;
+        }
+        sink = sum;
+    });
+}
+
+// insert `size` random keys, then extract them all
+template <typename HeapT>
+double benchSort(size_t size) {
+    std::minstd_rand rng(2);
+    return timeMs([&]() {
+        HeapT heap;
+        for (size_t i = 0; i < size; i++)
+            heap.insert(static_cast<int>(rng()));
+        long long sum = 0;
+        while (!heap.empty()) {
+            sum += heap.getMin();
+            heap.extractMin();
+        }
+        sink = sum;
+    });
+}
+
+// `count` heaps of `size` keys melded pairwise into one
+template <typename HeapT>
+double benchMeld(size_t count, size_t size) {
+    std::minstd_rand rng(3);
+    std::vector<HeapT> heaps(count);
+    for (HeapT &heap : heaps)
+        for (size_t i = 0; i < size; i++)
+            heap.insert(static_cast<int>(rng()));
+    return timeMs([&]() {
+        for (size_t step = 1; step < count; step *= 2)
+            for (size_t i = 0; i + step < count; i += 2 * step)
+                heaps[i].meld(std::move(heaps[i + step]));
+        sink = heaps[0].getMin();
+    });
+}
+
+template <typename HeapT>
+void benchRow(const std::string &name) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    for (size_t size : {1000, 100000, 1000000})
+        std::cout << std::setw(12) << benchHold<HeapT>(size, 1000000);
+    std::cout << std::setw(12) << benchSort<HeapT>(1000000);
+    std::cout << std::setw(12) << benchMeld<HeapT>(1024, 1000) << std::endl;
+}
+
+void benchOps() {
+    std::cout << "int keys, ms" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "hold 1e3" << std::setw(12) << "hold 1e5"
+              << std::setw(12) << "hold 1e6" << std::setw(12) << "sort 1e6" << std::setw(12) << "meld 1e6"
+              << std::endl;
+    benchRow<StupidHeap<int>>("multiset");
+    benchRow<BinomialHeap<int>>("binomial");
+    benchRow<LazyBinomialHeap<int>>("lazy binom");
+    benchRow<LeftistHeap<int>>("leftist");
+    benchRow<SkewHeap<int>>("skew");
+    benchRow<PairingHeap<int>>("pairing");
+    benchRow<FibonacciHeap<int>>("fibonacci");
+    benchRow<DaryHeap<int, 2>>("2-ary");
+    benchRow<DaryHeap<int, 4>>("4-ary");
+    benchRow<DaryHeap<int, 8>>("8-ary");
+    benchRow<DaryHeap<int, 16>>("16-ary");
+}
+
+
+// Random directed graph in adjacency arrays: `degree` edges out of every
+// vertex, weights 1..1000.
+struct Graph {
+    std::vector<size_t> first; // edges of v are [first[v], first[v + 1])
+    std::vector<int> to;
+    std::vector<int> weight;
+
+    Graph(size_t vertices, size_t degree): first(vertices + 1), to(vertices * degree), weight(vertices * degree) {
+        std::minstd_rand rng(4);
+        for (size_t v = 0; v <= vertices; v++)
+            first[v] = v * degree;
+        for (size_t e = 0; e < to.size(); e++) {
+            to[e] = static_cast<int>(rng() % vertices);
+            weight[e] = 1 + static_cast<int>(rng() % 1000);
+        }
+    }
+
+    size_t vertices() const {return first.size() - 1;}
+};
+
+typedef std::pair<long long, int> DistVertex;
+static const long long kUnreached = std::numeric_limits<long long>::max();
+
+// Dijkstra's algorithm without decreaseKey: a vertex is inserted again on
+// every improvement and stale entries are skipped when they come out.
+template <typename HeapT>
+long long lazyDijkstra(const Graph &graph, size_t &peakSize) {
+    std::vector<long long> dist(graph.vertices(), kUnreached);
+    HeapT heap;
+    size_t size = 1;
+    peakSize = 1;
+    dist[0] = 0;
+    heap.insert(DistVertex(0, 0));
+    while (!heap.empty()) {
+        DistVertex top = heap.getMin();
+        heap.extractMin();
+        size--;
+        if (top.first > dist[top.second])
+            continue;
+        for (size_t e = graph.first[top.second]; e < graph.first[top.second + 1]; e++) {
+            long long candidate = top.first + graph.weight[e];
+            if (candidate < dist[graph.to[e]]) {
+                dist[graph.to[e]] = candidate;
+                heap.insert(DistVertex(candidate, graph.to[e]));
+                peakSize = std::max(peakSize, ++size);
+            }
+        }
+    }
+    long long sum = 0;
+    for (long long d : dist)
+        sum += (d == kUnreached ? 0 : d);
+    return sum;
+}
+
+// Dijkstra's algorithm with one heap element per reached vertex.
+template <typename HeapT>
+long long addressableDijkstra(const Graph &graph, size_t &peakSize) {
+    std::vector<long long> dist(graph.vertices(), kUnreached);
+    std::vector<HeapHandle> handles(graph.vertices());
+    HeapT heap;
+    size_t size = 1;
+    peakSize = 1;
+    dist[0] = 0;
+    heap.insert(DistVertex(0, 0));
+    while (!heap.empty()) {
+        DistVertex top = heap.getMin();
+        heap.extractMin();
+        size--;
+        for (size_t e = graph.first[top.second]; e < graph.first[top.second + 1]; e++) {
+            int v = graph.to[e];
+            long long candidate = top.first + graph.weight[e];
+            if (candidate >= dist[v])
+                continue;
+            if (dist[v] == kUnreached) {
+                handles[v] = heap.insert(DistVertex(candidate, v));
+                peakSize = std::max(peakSize, ++size);
+            } else {
+                heap.decreaseKey(handles[v], DistVertex(candidate, v));
+            }
+            dist[v] = candidate;
+        }
+    }
+    long long sum = 0;
+    for (long long d : dist)
+        sum += (d == kUnreached ? 0 : d);
+    return sum;
+}
+
+template <typename Func>
+void dijkstraCells(Func run, long long &checksum) {
+    size_t peakSize = 0;
+    long long sum = 0;
+    std::cout << std::setw(12) << timeMs([&]() {sum = run(peakSize);}) << std::setw(12) << peakSize;
+    if (checksum != 0 && sum != checksum) {
+        std::cerr << "distances differ" << std::endl;
+        std::exit(1);
+    }
+    checksum = sum;
+}
+
+template <typename HeapT>
+void benchLazyDijkstraRow(const std::string &name, const Graph &graph, long long &checksum) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    dijkstraCells([&](size_t &peak) {return lazyDijkstra<HeapT>(graph, peak);}, checksum);
+    std::cout << std::endl;
+}
+
+template <typename HeapT>
+void benchDijkstraRow(const std::string &name, const Graph &graph, long long &checksum) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    dijkstraCells([&](size_t &peak) {return lazyDijkstra<HeapT>(graph, peak);}, checksum);
+    dijkstraCells([&](size_t &peak) {return addressableDijkstra<HeapT>(graph, peak);}, checksum);
+    std::cout << std::endl;
+}
+
+void benchDijkstra(size_t vertices, size_t degree) {
+    Graph graph(vertices, degree);
+    long long checksum = 0;
+    std::cout << "shortest paths, " << vertices << " vertices, " << vertices * degree << " edges" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "lazy, ms" << std::setw(12) << "peak size"
+              << std::setw(12) << "handles, ms" << std::setw(12) << "peak size" << std::endl;
+    benchLazyDijkstraRow<DaryHeap<DistVertex, 4>>("4-ary", graph, checksum);
+    benchDijkstraRow<BinomialHeap<DistVertex>>("binomial", graph, checksum);
+    benchDijkstraRow<LazyBinomialHeap<DistVertex>>("lazy binom", graph, checksum);
+    benchDijkstraRow<LeftistHeap<DistVertex>>("leftist", graph, checksum);
+    benchDijkstraRow<SkewHeap<DistVertex>>("skew", graph, checksum);
+    benchDijkstraRow<PairingHeap<DistVertex>>("pairing", graph, checksum);
+    benchDijkstraRow<FibonacciHeap<DistVertex>>("fibonacci", graph, checksum);
+}
+
+
+template <typename Func>
+void allocCells(Func func) {
+    size_t calls = newCalls;
+    std::cout << std::setw(12) << timeMs(func) << std::setw(12) << newCalls - calls;
+}
+
+// Time and operator new calls of filling a heap, a hold phase and tearing
+// the full heap down.
+template <typename HeapT>
+void benchAllocRow(const std::string &name, size_t size, size_t ops) {
+    std::minstd_rand rng(5);
+    std::unique_ptr<HeapT> heap(new HeapT());
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    allocCells([&]() {
+        for (size_t i = 0; i < size; i++)
+            heap->insert(static_cast<int>(rng()));
+    });
+    allocCells([&]() {
+        long long sum = 0;
+        for (size_t i = 0; i < ops; i++) {
+            int key = heap->getMin();
+            heap->extractMin();
+            heap->insert(key + static_cast<int>(rng() % 1000));
+            sum += key;
+        }
+        sink = sum;
+    });
+    allocCells([&]() {heap.reset();});
+    std::cout << std::endl;
+}
+
+void benchAlloc(size_t size, size_t ops) {
+    std::cout << size << " int keys, then " << ops << " extractMin + insert" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "fill, ms" << std::setw(12) << "news"
+              << std::setw(12) << "hold, ms" << std::setw(12) << "news"
+              << std::setw(12) << "teardown" << std::setw(12) << "news" << std::endl;
+    benchAllocRow<LeftistHeap<int>>("leftist", size, ops);
+    benchAllocRow<SkewHeap<int>>("skew", size, ops);
+    benchAllocRow<BinomialHeap<int>>("binomial", size, ops);
+    benchAllocRow<LazyBinomialHeap<int>>("lazy binom", size, ops);
+}
+
+
+// Building a heap of the keys (up to the first extractMin, which the lazy
+// heaps leave the work to), by repeated insert or by the range constructor.
+template <typename HeapT>
+double buildMs(const std::vector<int> &keys, bool bulk) {
+    std::unique_ptr<HeapT> heap;
+    double ms = timeMs([&]() {
+        if (bulk) {
+            heap.reset(new HeapT(keys.begin(), keys.end()));
+        } else {
+            heap.reset(new HeapT());
+            for (int key : keys)
+                heap->insert(key);
+        }
+        heap->extractMin();
+        sink = heap->getMin();
+    });
+    return ms;
+}
+
+template <typename HeapT>
+void benchBulkRow(const std::string &name, const std::vector<int> &random, const std::vector<int> &sorted) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    for (const std::vector<int> *keys : {&random, &sorted})
+        std::cout << std::setw(12) << buildMs<HeapT>(*keys, false) << std::setw(12) << buildMs<HeapT>(*keys, true);
+    std::cout << std::endl;
+}
+
+void benchBulk(size_t size) {
+    std::minstd_rand rng(6);
+    std::vector<int> random(size), sorted(size);
+    for (size_t i = 0; i < size; i++) {
+        random[i] = static_cast<int>(rng());
+        sorted[i] = static_cast<int>(i);
+    }
+    std::cout << size << " int keys, build + extractMin, ms" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "rand insert" << std::setw(12) << "rand bulk"
+              << std::setw(12) << "sort insert" << std::setw(12) << "sort bulk" << std::endl;
+    benchBulkRow<StupidHeap<int>>("multiset", random, sorted);
+    benchBulkRow<BinomialHeap<int>>("binomial", random, sorted);
+    benchBulkRow<LazyBinomialHeap<int>>("lazy binom", random, sorted);
+    benchBulkRow<LeftistHeap<int>>("leftist", random, sorted);
+    benchBulkRow<SkewHeap<int>>("skew", random, sorted);
+    benchBulkRow<PairingHeap<int>>("pairing", random, sorted);
+    benchBulkRow<FibonacciHeap<int>>("fibonacci", random, sorted);
+    benchBulkRow<DaryHeap<int, 4>>("4-ary", random, sorted);
+}
+
+// Operation mixes on a heap of `size` keys: every round reads the minimum
+// `reads` times, inserts `inserts` keys and extracts one.
+template <typename HeapT>
+double benchMix(size_t size, size_t rounds, size_t reads, size_t inserts) {
+    std::minstd_rand rng(7);
+    HeapT heap;
+    for (size_t i = 0; i < size; i++)
+        heap.insert(static_cast<int>(rng() % 1000000));
+    return timeMs([&]() {
+        long long sum = 0;
+        for (size_t round = 0; round < rounds; round++) {
+            for (size_t i = 0; i < reads; i++)
+                sum += heap.getMin();
+            int key = heap.getMin();
+            for (size_t i = 0; i < inserts; i++)
+                heap.insert(key + static_cast<int>(rng() % 1000));
+            heap.extractMin();
+        }
+        sink = sum;
+    });
+}
+
+template <typename HeapT>
+void benchMixRow(const std::string &name) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1)
+              << std::setw(12) << benchMix<HeapT>(100000, 1000000, 16, 1)
+              << std::setw(12) << benchMix<HeapT>(100000, 1000000, 0, 1)
+              << std::setw(12) << benchMix<HeapT>(1000, 1000000, 0, 8) << std::endl;
+}
+
+void benchMixes() {
+    std::cout << "1e6 rounds of getMin x reads, insert x inserts, extractMin; ms" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "1e5 16/1" << std::setw(12) << "1e5 0/1"
+              << std::setw(12) << "1e3 0/8" << std::endl;
+    benchMixRow<BinomialHeap<int>>("binomial");
+    benchMixRow<LazyBinomialHeap<int>>("lazy binom");
+    benchMixRow<FibonacciHeap<int>>("fibonacci");
+    benchMixRow<PairingHeap<int>>("pairing");
+    benchMixRow<LeftistHeap<int>>("leftist");
+    benchMixRow<DaryHeap<int, 4>>("4-ary");
+}
+
+// The TestCompareHeaps workload: a set of small heaps under random
+// addHeap / insert / getMin / extractMin / meld, called on the heap types
+// themselves or through IHeap. Heaps melded away or emptied are swapped
+// with the last one, or erased in order like in HeapCollection.
+template <typename Heap, typename Make>
+double benchCollection(size_t ops, Make make, bool ordered = false) {
+    std::minstd_rand rng(8);
+    std::vector<std::unique_ptr<Heap>> heaps;
+    auto remove = [&](size_t index) {
+        if (ordered) {
+            heaps.erase(heaps.begin() + index);
+            return;
+        }
+        heaps[index] = std::move(heaps.back());
+        heaps.pop_back();
+    };
+    return timeMs([&]() {
+        long long sum = 0;
+        for (size_t i = 0; i < ops; i++) {
+            int key = 1 + static_cast<int>(rng() % 100);
+            size_t op = rng() % 5;
+            if (heaps.empty() || op == 0) {
+                heaps.push_back(make());
+                heaps.back()->insert(key);
+                continue;
+            }
+            size_t index1 = rng() % heaps.size();
+            size_t index2 = rng() % heaps.size();
+            if (op == 1) {
+                heaps[index1]->insert(key);
+            } else if (op == 2) {
+                sum += heaps[index1]->getMin();
+            } else if (op == 3) {
+                heaps[index1]->extractMin();
+                if (heaps[index1]->empty())
+                    remove(index1);
+            } else if (index1 != index2) {
+                heaps[index1]->meld(std::move(*heaps[index2]));
+                remove(index2);
+            }
+        }
+        sink = sum + static_cast<long long>(heaps.size());
+    });
+}
+
+// best of three, the heaps being small and the runs short
+template <typename HeapT>
+void benchDispatchRow(const std::string &name, size_t ops) {
+    double staticMs = std::numeric_limits<double>::max();
+    double virtualMs = std::numeric_limits<double>::max();
+    for (int run = 0; run < 3; run++) {
+        staticMs = std::min(staticMs, benchCollection<HeapT>(ops, []() {
+            return std::unique_ptr<HeapT>(new HeapT());
+        }));
+        virtualMs = std::min(virtualMs, benchCollection<IHeap<int>>(ops, []() {
+            return std::unique_ptr<IHeap<int>>(new HeapAdapter<HeapT>());
+        }));
+    }
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1)
+              << std::setw(12) << staticMs << std::setw(12) << virtualMs << std::endl;
+}
+
+void benchDispatch(size_t ops) {
+    std::cout << ops << " TestCompareHeaps operations, ms" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "static" << std::setw(12) << "IHeap" << std::endl;
+    benchDispatchRow<BinomialHeap<int>>("binomial", ops);
+    benchDispatchRow<LazyBinomialHeap<int>>("lazy binom", ops);
+    benchDispatchRow<LeftistHeap<int>>("leftist", ops);
+    benchDispatchRow<SkewHeap<int>>("skew", ops);
+    benchDispatchRow<PairingHeap<int>>("pairing", ops);
+    benchDispatchRow<FibonacciHeap<int>>("fibonacci", ops);
+    benchDispatchRow<DaryHeap<int, 4>>("4-ary", ops);
+}
+
+// A 200-byte task record with a priority that counts its copies.
+struct Task {
+    static size_t copies;
+    int priority;
+    char payload[196];
+
+    explicit Task(int priority): priority(priority), payload() {}
+    Task(const Task &other): priority(other.priority) {
+        std::memcpy(payload, other.payload, sizeof(payload));
+        copies++;
+    }
+    Task(Task &&other): priority(other.priority) {
+        std::memcpy(payload, other.payload, sizeof(payload));
+    }
+    Task& operator=(const Task &other) {
+        priority = other.priority;
+        std::memcpy(payload, other.payload, sizeof(payload));
+        copies++;
+        return *this;
+    }
+    Task& operator=(Task &&other) {
+        priority = other.priority;
+        std::memcpy(payload, other.payload, sizeof(payload));
+        return *this;
+    }
+};
+size_t Task::copies = 0;
+
+struct ByPriority {
+    bool operator()(const Task &a, const Task &b) const {return a.priority < b.priority;}
+};
+
+// The hold model on tasks: copying (a task built and inserted, getMin
+// copied out, then extractMin) or moving (emplace and pop).
+template <typename HeapT>
+void taskCells(size_t size, size_t ops, bool moving) {
+    std::minstd_rand rng(9);
+    HeapT heap;
+    for (size_t i = 0; i < size; i++)
+        heap.emplace(static_cast<int>(rng() % 1000000));
+    Task::copies = 0;
+    double ms = timeMs([&]() {
+        long long sum = 0;
+        for (size_t i = 0; i < ops; i++) {
+            if (moving) {
+                Task task = heap.pop();
+                sum += task.priority;
+                heap.emplace(task.priority + static_cast<int>(rng() % 1000));
+            } else {
+                Task task = heap.getMin();
+                heap.extractMin();
+                sum += task.priority;
+                Task next(task.priority + static_cast<int>(rng() % 1000));
+                heap.insert(next);
+            }
+        }
+        sink = sum;
+    });
+    std::cout << std::setw(12) << ms << std::setw(12) << Task::copies;
+}
+
+template <typename HeapT>
+void benchTaskRow(const std::string &name, size_t size, size_t ops) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    taskCells<HeapT>(size, ops, false);
+    taskCells<HeapT>(size, ops, true);
+    std::cout << std::endl;
+}
+
+void benchTasks(size_t size, size_t ops) {
+    std::cout << size << " tasks of " << sizeof(Task) << " bytes, " << ops << " pop + push" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "copy, ms" << std::setw(12) << "copies"
+              << std::setw(12) << "move, ms" << std::setw(12) << "copies" << std::endl;
+    benchTaskRow<StupidHeap<Task, ByPriority>>("multiset", size, ops);
+    benchTaskRow<BinomialHeap<Task, ByPriority>>("binomial", size, ops);
+    benchTaskRow<LazyBinomialHeap<Task, ByPriority>>("lazy binom", size, ops);
+    benchTaskRow<LeftistHeap<Task, ByPriority>>("leftist", size, ops);
+    benchTaskRow<SkewHeap<Task, ByPriority>>("skew", size, ops);
+    benchTaskRow<PairingHeap<Task, ByPriority>>("pairing", size, ops);
+    benchTaskRow<FibonacciHeap<Task, ByPriority>>("fibonacci", size, ops);
+    benchTaskRow<DaryHeap<Task, 4, ByPriority>>("4-ary", size, ops);
+}
+
+// The baseline: one heap behind one mutex.
+template <typename HeapT>
+class LockedHeap {
+private:
+    std::mutex lock;
+    HeapT heap;
+
+public:
+    explicit LockedHeap(size_t) {}
+
+    void insert(int key) {
+        std::lock_guard<std::mutex> guard(lock);
+        heap.insert(key);
+    }
+
+    bool tryPop(int &key) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (heap.empty())
+            return false;
+        key = heap.pop();
+        return true;
+    }
+};
+
+// Million operations per second of `threads` threads that each pop a key
+// and insert a later one, on a queue prefilled with `size` keys.
+template <typename QueueT>
+double queueThroughput(size_t threads, size_t shards, size_t size, size_t ops) {
+    QueueT queue(shards);
+    std::minstd_rand rng(10);
+    for (size_t i = 0; i < size; i++)
+        queue.insert(static_cast<int>(rng() % 1000000));
+    std::vector<std::thread> workers;
+    std::vector<long long> sums(threads, 0); // one per thread, summed after join
+    double ms = timeMs([&]() {
+        for (size_t t = 0; t < threads; t++) {
+            workers.emplace_back([&queue, &sums, t, threads, ops]() {
+                std::minstd_rand local(static_cast<unsigned>(t) + 11);
+                long long sum = 0;
+                for (size_t i = 0; i < ops / threads; i++) {
+                    int key = 0;
+                    if (queue.tryPop(key))
+                        sum += key;
+                    queue.insert(key + static_cast<int>(local() % 1000));
+                }
+                sums[t] = sum;
+            });
+        }
+        for (std::thread &worker : workers)
+            worker.join();
+    });
+    long long sum = 0;
+    for (long long threadSum : sums)
+        sum += threadSum;
+    sink = sum;
+    return 2 * static_cast<double>(ops) / ms / 1000;
+}
+
+// Mean rank of popped keys among the queued ones, single-threaded.
+template <typename QueueT>
+double queueRankError(size_t shards, size_t size, size_t pops) {
+    QueueT queue(shards);
+    std::minstd_rand rng(12);
+    std::vector<int> keys(size);
+    for (size_t i = 0; i < size; i++)
+        keys[i] = static_cast<int>(i);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int key : keys)
+        queue.insert(key);
+
+    // counts of keys still queued, as a Fenwick tree over the key values
+    std::vector<int> tree(size + 1, 0);
+    for (size_t i = 1; i <= size; i++) {
+        tree[i]++;
+        if (i + (i & -i) <= size)
+            tree[i + (i & -i)] += tree[i];
+    }
+    double rankSum = 0;
+    for (size_t i = 0; i < pops; i++) {
+        int key = 0;
+        queue.tryPop(key);
+        for (size_t j = key; j > 0; j -= j & -j)
+            rankSum += tree[j];
+        for (size_t j = key + 1; j <= size; j += j & -j)
+            tree[j]--;
+    }
+    return rankSum / pops;
+}
+
+void benchQueues(size_t size, size_t ops) {
+    std::cout << size << " int keys, " << ops << " pop + insert over all threads, "
+              << std::thread::hardware_concurrency() << " hardware threads; Mops/s" << std::endl;
+    std::cout << std::setw(12) << "threads" << std::setw(12) << "locked" << std::setw(12) << "mq leftist"
+              << std::setw(12) << "mq 4-ary" << std::setw(12) << "rank error" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (size_t threads : {1, 2, 4, 8, 16, 32}) {
+        size_t shards = 2 * threads;
+        std::cout << std::setw(12) << threads
+                  << std::setw(12) << queueThroughput<LockedHeap<LeftistHeap<int>>>(threads, 1, size, ops)
+                  << std::setw(12) << queueThroughput<MultiQueue<LeftistHeap<int>>>(threads, shards, size, ops)
+                  << std::setw(12) << queueThroughput<MultiQueue<DaryHeap<int, 4>>>(threads, shards, size, ops)
+                  << std::setw(12) << queueRankError<MultiQueue<DaryHeap<int, 4>>>(shards, size, 100000)
+                  << std::endl;
+    }
+}
+
+// Versions of one heap of `size` keys: every snapshot is taken from the
+// last one and then changed by `changes` extractMin + insert, and all are
+// kept. A persistent heap shares the nodes, a mutable one is deep-copied.
+template <typename HeapT, typename Change>
+void snapshotCells(size_t size, size_t snapshots, size_t changes, Change change) {
+    std::minstd_rand rng(13);
+    std::vector<HeapT> versions(1);
+    for (size_t i = 0; i < size; i++)
+        change(versions[0], static_cast<int>(rng()), false);
+    size_t bytes = liveBytes;
+    double ms = timeMs([&]() {
+        for (size_t i = 0; i < snapshots; i++) {
+            versions.push_back(versions.back());
+            for (size_t j = 0; j < changes; j++)
+                change(versions.back(), static_cast<int>(rng()), true);
+        }
+    });
+    std::cout << std::setw(12) << ms << std::setw(12) << (liveBytes - bytes) / snapshots;
+}
+
+template <typename HeapT>
+void benchPersistentRow(const std::string &name, size_t size, size_t snapshots) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    for (size_t changes : {1, 10}) {
+        snapshotCells<HeapT>(size, snapshots, changes, [](HeapT &heap, int key, bool extract) {
+            heap = (extract ? heap.extractMin() : heap).insert(key);
+        });
+    }
+    std::cout << std::endl;
+}
+
+template <typename HeapT>
+void benchCopiedRow(const std::string &name, size_t size, size_t snapshots) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    for (size_t changes : {1, 10}) {
+        snapshotCells<HeapT>(size, snapshots, changes, [](HeapT &heap, int key, bool extract) {
+            if (extract)
+                heap.extractMin();
+            heap.insert(key);
+        });
+    }
+    std::cout << std::endl;
+}
+
+void benchPersistent(size_t size, size_t snapshots) {
+    std::cout << snapshots << " snapshots of " << size << " int keys, each changed by 1 or 10 extractMin + insert"
+              << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "1: ms" << std::setw(12) << "bytes each"
+              << std::setw(12) << "10: ms" << std::setw(12) << "bytes each" << std::endl;
+    benchPersistentRow<PersistentLeftistHeap<int>>("p-leftist", size, snapshots);
+    benchPersistentRow<PersistentSkewHeap<int>>("p-skew", size, snapshots);
+    benchCopiedRow<DaryHeap<int, 4>>("4-ary copy", size, snapshots);
+}
+
+
+// Discrete event simulation: `size` events pending, and each one taken out
+// schedules another after a delay from the trace, so times only grow.
+typedef std::pair<unsigned long long, unsigned> Event;
+
+struct ByTime {
+    bool operator()(const Event &a, const Event &b) const {return a.first < b.first;}
+};
+
+enum class Trace {UNIFORM, EXPONENTIAL, BIMODAL};
+
+template <typename HeapT>
+double simulationMs(Trace trace, size_t size, size_t ops) {
+    std::minstd_rand rng(14);
+    std::exponential_distribution<double> exponential(1.0 / 1000);
+    auto delay = [&]() -> unsigned long long {
+        switch (trace) {
+        case Trace::UNIFORM: return rng() % 2000;
+        case Trace::EXPONENTIAL: return static_cast<unsigned long long>(exponential(rng));
+        default: return (rng() % 10 == 0 ? 1000000 + rng() % 1000000 : rng() % 20); // timers and retries
+        }
+    };
+    HeapT events;
+    for (size_t i = 0; i < size; i++)
+        events.insert(Event(delay(), static_cast<unsigned>(i)));
+    return timeMs([&]() {
+        unsigned long long sum = 0;
+        for (size_t i = 0; i < ops; i++) {
+            Event event = events.pop();
+            events.insert(Event(event.first + delay(), event.second));
+            sum += event.second;
+        }
+        sink = sum;
+    });
+}
+
+template <typename HeapT>
+void benchEventRow(const std::string &name, size_t size, size_t ops) {
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1);
+    for (Trace trace : {Trace::UNIFORM, Trace::EXPONENTIAL, Trace::BIMODAL})
+        std::cout << std::setw(12) << simulationMs<HeapT>(trace, size, ops);
+    std::cout << std::endl;
+}
+
+void benchEvents(size_t size, size_t ops) {
+    std::cout << size << " pending events, " << ops << " taken out and rescheduled, ms" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "uniform" << std::setw(12) << "exponential"
+              << std::setw(12) << "bimodal" << std::endl;
+    benchEventRow<RadixHeap<unsigned long long, unsigned>>("radix", size, ops);
+    benchEventRow<DaryHeap<Event, 4, ByTime>>("4-ary", size, ops);
+    benchEventRow<BinomialHeap<Event, ByTime>>("binomial", size, ops);
+    benchEventRow<LeftistHeap<Event, ByTime>>("leftist", size, ops);
+    benchEventRow<SkewHeap<Event, ByTime>>("skew", size, ops);
+    benchEventRow<PairingHeap<Event, ByTime>>("pairing", size, ops);
+}
+
+
+// Filling a heap with `size` random keys and draining it, with the memory
+// in use (live bytes of operator new) after the fill. The external heap
+// gets `memoryBytes`, far below the size of the keys.
+template <typename HeapT, typename... Args>
+void externalCells(size_t size, Args&&... args) {
+    std::minstd_rand rng(15);
+    size_t bytes = liveBytes;
+    std::unique_ptr<HeapT> heap(new HeapT(std::forward<Args>(args)...));
+    size_t used = 0;
+    std::cout << std::setw(12) << timeMs([&]() {
+        for (size_t i = 0; i < size; i++)
+            heap->insert(static_cast<int>(rng()));
+        used = liveBytes - bytes;
+    });
+    std::cout << std::setw(12) << timeMs([&]() {
+        long long sum = 0;
+        while (!heap->empty())
+            sum += heap->pop();
+        sink = sum;
+    });
+    std::cout << std::setw(12) << used / 1024 << std::endl;
+}
+
+void benchExternal(size_t size, size_t memoryBytes) {
+    std::cout << size << " int keys (" << size * sizeof(int) / (1 << 20) << " MB), external heap in "
+              << memoryBytes / (1 << 20) << " MB" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "fill, ms" << std::setw(12) << "drain, ms"
+              << std::setw(12) << "memory, KB" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(12) << "external";
+    externalCells<ExternalHeap<int>>(size, memoryBytes);
+    std::cout << std::setw(12) << "4-ary";
+    externalCells<DaryHeap<int, 4>>(size);
+}
+
+
+// k-way merge of `size` keys in k sorted runs, by a loser tree or by a
+// heap of (head key, run) pairs: one extractMin and one insert per key.
+typedef std::vector<std::vector<int>> Runs;
+
+Runs sortedRuns(size_t size, size_t k) {
+    std::minstd_rand rng(16);
+    Runs runs(k);
+    for (size_t i = 0; i < size; i++)
+        runs[rng() % k].push_back(static_cast<int>(rng()));
+    for (std::vector<int> &run : runs)
+        std::sort(run.begin(), run.end());
+    return runs;
+}
+
+double loserTreeMergeMs(const Runs &runs, std::vector<int> &out) {
+    typedef std::vector<int>::const_iterator It;
+    std::vector<std::pair<It, It>> ranges;
+    for (const std::vector<int> &run : runs)
+        ranges.push_back(std::make_pair(run.cbegin(), run.cend()));
+    return timeMs([&]() {mergeRanges(ranges, out.begin());});
+}
+
+template <typename HeapT>
+double heapMergeMs(const Runs &runs, std::vector<int> &out) {
+    return timeMs([&]() {
+        std::vector<size_t> next(runs.size(), 1);
+        HeapT heap;
+        for (size_t i = 0; i < runs.size(); i++)
+            if (!runs[i].empty())
+                heap.insert(std::make_pair(runs[i][0], i));
+        for (int &key : out) {
+            std::pair<int, size_t> head = heap.pop();
+            key = head.first;
+            if (next[head.second] < runs[head.second].size())
+                heap.insert(std::make_pair(runs[head.second][next[head.second]++], head.second));
+        }
+    });
+}
+
+void benchMerge(size_t size) {
+    std::cout << size << " int keys in k sorted runs, merge ms" << std::endl;
+    std::cout << std::setw(12) << "k" << std::setw(12) << "loser tree" << std::setw(12) << "4-ary"
+              << std::setw(12) << "leftist" << std::endl;
+    std::cout << std::fixed << std::setprecision(1);
+    std::vector<int> out(size);
+    for (size_t k : {2, 4, 10, 100, 1000, 10000}) {
+        Runs runs = sortedRuns(size, k);
+        std::cout << std::setw(12) << k;
+        std::cout << std::setw(12) << loserTreeMergeMs(runs, out);
+        sink = out[size / 2];
+        std::cout << std::setw(12) << heapMergeMs<DaryHeap<std::pair<int, size_t>, 4>>(runs, out);
+        std::cout << std::setw(12) << heapMergeMs<LeftistHeap<std::pair<int, size_t>>>(runs, out);
+        std::cout << std::endl;
+    }
+}
+
+
+// benchCollection on a HeapForest: the live handles are kept in a vector
+// to pick from at random, as a user of the forest would.
+template <typename HeapT>
+double benchForest(size_t ops) {
+    typedef HeapForest<HeapT> Forest;
+    std::minstd_rand rng(8);
+    Forest forest;
+    std::vector<typename Forest::Handle> heaps;
+    auto remove = [&](size_t index) {
+        heaps[index] = heaps.back();
+        heaps.pop_back();
+    };
+    return timeMs([&]() {
+        long long sum = 0;
+        for (size_t i = 0; i < ops; i++) {
+            int key = 1 + static_cast<int>(rng() % 100);
+            size_t op = rng() % 5;
+            if (heaps.empty() || op == 0) {
+                heaps.push_back(forest.addHeap());
+                forest.insert(heaps.back(), key);
+                continue;
+            }
+            size_t index1 = rng() % heaps.size();
+            size_t index2 = rng() % heaps.size();
+            if (op == 1) {
+                forest.insert(heaps[index1], key);
+            } else if (op == 2) {
+                sum += forest.getMin(heaps[index1]);
+            } else if (op == 3) {
+                forest.extractMin(heaps[index1]);
+                if (forest.empty(heaps[index1])) {
+                    forest.removeHeap(heaps[index1]);
+                    remove(index1);
+                }
+            } else if (index1 != index2) {
+                forest.meld(heaps[index1], heaps[index2]);
+                remove(index2);
+            }
+        }
+        sink = sum + static_cast<long long>(forest.size());
+    });
+}
+
+// Heaps on one shared pool when they take one, as in the forest: a pool of
+// their own each would cost the baselines far more than their containers.
+// Result is HeapT or an adapter over it.
+template <typename HeapT, typename Result = HeapT>
+typename std::enable_if<std::is_constructible<HeapT, std::shared_ptr<NodePool>>::value, Result*>::type
+newHeapOn(const std::shared_ptr<NodePool> &pool) {
+    return new Result(pool);
+}
+
+template <typename HeapT, typename Result = HeapT>
+typename std::enable_if<!std::is_constructible<HeapT, std::shared_ptr<NodePool>>::value, Result*>::type
+newHeapOn(const std::shared_ptr<NodePool>&) {
+    return new Result();
+}
+
+template <typename HeapT>
+void benchForestRow(const std::string &name, size_t ops) {
+    typedef typename HeapT::value_type T;
+    std::shared_ptr<NodePool> pool = std::make_shared<NodePool>();
+    auto makeIHeap = [&]() {return std::unique_ptr<IHeap<T>>(newHeapOn<HeapT, HeapAdapter<HeapT>>(pool));};
+    auto makeHeap = [&]() {return std::unique_ptr<HeapT>(newHeapOn<HeapT>(pool));};
+    std::cout << std::setw(12) << name << std::fixed << std::setprecision(1)
+              << std::setw(12) << benchCollection<IHeap<T>>(ops, makeIHeap, true)
+              << std::setw(12) << benchCollection<HeapT>(ops, makeHeap)
+              << std::setw(12) << benchForest<HeapT>(ops) << std::endl;
+}
+
+void benchForests(size_t ops) {
+    std::cout << ops << " TestCompareHeaps operations, ms" << std::endl;
+    std::cout << std::setw(12) << "heap" << std::setw(12) << "IHeap erase" << std::setw(12) << "swap"
+              << std::setw(12) << "forest" << std::endl;
+    benchForestRow<LeftistHeap<int>>("leftist", ops);
+    benchForestRow<SkewHeap<int>>("skew", ops);
+    benchForestRow<BinomialHeap<int>>("binomial", ops);
+    benchForestRow<PairingHeap<int>>("pairing", ops);
+    benchForestRow<DaryHeap<int, 4>>("4-ary", ops);
+}
+
+
+// usage: bench_heap [ops|dijkstra|alloc|bulk|mix|dispatch|tasks|queue|persistent|events|external|merge|forest]...
+int main(int argc, char **argv) {
+    std::vector<std::string> benches(argv + 1, argv + argc);
+    if (benches.empty())
+        benches = {"ops", "dijkstra", "alloc", "bulk", "mix", "dispatch", "tasks", "queue",
+                   "persistent", "events", "external", "merge", "forest"};
+
+    for (const std::string &bench : benches) {
+        if (bench == "ops") {
+            benchOps();
+        } else if (bench == "dijkstra") {
+            benchDijkstra(1000000, 8);
+            std::cout << std::endl;
+            benchDijkstra(50000, 200);
+        } else if (bench == "alloc") {
+            benchAlloc(1000000, 5000000);
+        } else if (bench == "bulk") {
+            benchBulk(10000000);
+        } else if (bench == "mix") {
+            benchMixes();
+        } else if (bench == "dispatch") {
+            benchDispatch(1000000);
+        } else if (bench == "tasks") {
+            benchTasks(100000, 1000000);
+        } else if (bench == "queue") {
+            benchQueues(1000000, 4000000);
+        } else if (bench == "persistent") {
+            benchPersistent(100000, 200);
+        } else if (bench == "events") {
+            benchEvents(1000000, 1000000);
+        } else if (bench == "external") {
+            benchExternal(20000000, static_cast<size_t>(4) << 20);
+        } else if (bench == "merge") {
+            benchMerge(10000000);
+        } else if (bench == "forest") {
+            benchForests(10000000);
+        } else {
+            std::cerr << "unknown benchmark: " << bench << std::endl;
+            return 1;
+        }
+        std::cout << std::endl;
+    }
+}
@@ -1,40 +1,65 @@
 #include <cassert>
+#include <functional>
 #include <utility>
 #include <iterator>
 #include <list>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
 #include "heap.h"
+#include "node_pool.h"
 
 
-template <typename T>
-struct BinomialHeap : public IHeap<T> {
+template <typename T, typename Compare = std::less<T>>
+struct BinomialHeap {
 private:
     struct BinomialTree;
-    typedef typename std::list<BinomialTree> TreeList;
+    typedef NodePoolAllocator<BinomialTree> TreeAllocator;
+    typedef typename std::list<BinomialTree, TreeAllocator> TreeList;
     typedef typename TreeList::iterator tree_iter;
     typedef typename TreeList::const_iterator const_tree_iter;
 
+    // What a handle points to. decreaseKey moves keys up the tree (list
+    // nodes never move), and the entry of a key moves along with it.
+    struct Entry {
+        BinomialTree *tree;
+    };
+
     struct BinomialTree {
         T key;
+        Entry *entry;
+        BinomialTree *parent;
         TreeList children; // degree-increasing order       
-        BinomialTree(T key): key(key), children() {}
+        template <typename... Args>
+        BinomialTree(Entry *entry, const TreeAllocator &alloc, Args&&... args):
+                key(std::forward<Args>(args)...), entry(entry), parent(nullptr), children(alloc) {
+            entry->tree = this;
+        }
 
         size_t degree() const {
             return children.size(); // O(1) since c++11
         }
 
-        bool checkInvariant() const {
+        bool checkInvariant(const Compare &less) const {
             if (!children.empty() && children.back().degree() != degree() - 1)
                 return false;
             size_t deg;
             const_tree_iter child;
             for (deg = 1, child = children.begin(); child != children.end(); child++, deg++)
-                if (!(key <= child->key && deg == child->degree() && child->checkInvariant()))
+                if (!(!less(child->key, key) && deg == child->degree() && child->parent == this &&
+                      child->checkInvariant(less)))
                     return false;
             return true;
         }
     };
 
-    TreeList trees; // degree-increasing order
+    // list nodes and entries both come from the pool
+    std::shared_ptr<NodePool> pool;
+    union {
+        TreeList trees; // degree-increasing order; destroyed by ~BinomialHeap, if at all
+    };
+    Compare less;
 
     bool checkInvariant() const {
         const_tree_iter curr;
@@ -44,22 +69,125 @@ private:
         return true;
     }
 
-    BinomialHeap(TreeList &&trees): trees(std::move(trees)) {}
+    BinomialHeap(TreeList &&trees, const Compare &less):
+            pool(trees.get_allocator().getPool()), trees(std::move(trees)), less(less) {
+        pool->attach();
+    }
+
+    // the single trees of a and b have equal degrees; they are linked in a
+    void link(TreeList &a, TreeList &b) {
+        if (less(b.front().key, a.front().key))
+            a.swap(b);
+        a.front().children.splice(a.front().children.end(), b);
+        a.front().children.back().parent = &a.front();
+    }
+
+    void deleteEntries(TreeList &list) {
+        for (BinomialTree &tree : list) {
+            deleteEntries(tree.children);
+            pool->deallocate(tree.entry, sizeof(Entry));
+        }
+    }
+
+    // Returns the tree the key ends up in: its root with toRoot,
+    // otherwise the first one with a parent that is not greater.
+    BinomialTree* siftUp(BinomialTree *tree, bool toRoot) {
+        while (tree->parent != nullptr && (toRoot || less(tree->key, tree->parent->key))) {
+            BinomialTree *parent = tree->parent;
+            std::swap(tree->key, parent->key);
+            std::swap(tree->entry, parent->entry);
+            tree->entry->tree = tree;
+            parent->entry->tree = parent;
+            tree = parent;
+        }
+        return tree;
+    }
+
+    tree_iter minRoot() {
+        assert(checkInvariant());
+        assert(!trees.empty());
+        tree_iter minTree = trees.begin();
+        for (tree_iter curr = trees.begin(); curr != trees.end(); curr++)
+            if (less(curr->key, minTree->key))
+                minTree = curr;
+        return minTree;
+    }
+
+    void removeRoot(tree_iter root) {
+        pool->deallocate(root->entry, sizeof(Entry));
+        TreeList children = std::move(root->children);
+        for (BinomialTree &child : children)
+            child.parent = nullptr;
+        trees.erase(root);
+        meld(BinomialHeap(std::move(children), less));
+    }
 
 public:
-    BinomialHeap(): trees() {}
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    explicit BinomialHeap(const Compare &less = Compare()): BinomialHeap(std::make_shared<NodePool>(), less) {}
 
-    T getMin() const {
+    explicit BinomialHeap(std::shared_ptr<NodePool> pool, const Compare &less = Compare()):
+            pool(pool), trees(TreeAllocator(pool)), less(less) {
+        this->pool->attach();
+    }
+
+    // O(n): the trees are built like a binary counter is incremented,
+    // slots[d] holding the tree of degree d, if any
+    template <typename InputIt>
+    BinomialHeap(InputIt first, InputIt last, std::shared_ptr<NodePool> pool = std::make_shared<NodePool>(),
+                 const Compare &less = Compare()): BinomialHeap(std::move(pool), less) {
+        std::vector<TreeList> slots;
+        for (; first != last; ++first) {
+            TreeList carry(trees.get_allocator());
+            Entry *entry = new (this->pool->allocate(sizeof(Entry))) Entry();
+            carry.emplace_back(entry, trees.get_allocator(), *first);
+            size_t degree = 0;
+            for (; degree < slots.size() && !slots[degree].empty(); degree++)
+                link(carry, slots[degree]);
+            if (degree == slots.size())
+                slots.emplace_back(trees.get_allocator());
+            slots[degree].swap(carry);
+        }
+        for (TreeList &slot : slots)
+            trees.splice(trees.end(), slot);
+    }
+
+    BinomialHeap(BinomialHeap &&other): pool(other.pool), trees(TreeAllocator(other.pool)), less(other.less) {
+        pool->attach();
+        trees.swap(other.trees);
+    }
+
+    BinomialHeap(const BinomialHeap&) = delete;
+    BinomialHeap& operator=(const BinomialHeap &other) = delete;
+
+    // On release() the lists are left in the slabs. Otherwise they go
+    // before detach, which may free the merged pools their allocators
+    // point to.
+    ~BinomialHeap() {
+        const bool releases = std::is_trivially_destructible<T>::value && pool->lastUser();
+        if (!releases) {
+            deleteEntries(trees);
+            trees.~TreeList();
+        }
+        pool->detach();
+        if (releases)
+            pool->release();
+    }
+
+    const T& getMin() const {
         assert(checkInvariant());
         const_tree_iter minTree = trees.begin();
         for (const_tree_iter curr = trees.begin(); curr != trees.end(); curr++)
-            if (curr->key < minTree->key)
+            if (less(curr->key, minTree->key))
                 minTree = curr;
         return minTree->key;
     }
     
     void meld(BinomialHeap &&other) {
         if (this == &other || other.trees.empty()) return;
+        NodePool::merge(*pool, *other.pool);
         assert(this->checkInvariant() && other.checkInvariant());
 
         this->trees.merge(std::move(other.trees),
@@ -73,9 +201,10 @@ public:
             // invariant: [curr, curr + 1, ...] - strictly increasing degrees
             while (curr != trees.end() && std::prev(curr)->degree() == curr->degree()) {
                 tree_iter prev = std::prev(curr);
-                if (curr->key > prev->key)
+                if (less(prev->key, curr->key))
                     std::swap(curr, prev);
                 curr->children.splice(curr->children.end(), trees, prev);
+                curr->children.back().parent = &*curr;
                 curr++;
             }
             curr--;
@@ -84,27 +213,50 @@ public:
         assert(this->checkInvariant() && other.checkInvariant());
     }
 
-    virtual void meld(IHeap<T> &&other) override {
-        meld(std::move(dynamic_cast<BinomialHeap&>(other)));
+    HeapHandle insert(T key) {
+        return emplace(std::move(key));
     }
 
-    virtual void insert(T key) override {
-        meld(TreeList{BinomialTree(key)});
+    // the key is constructed in its node
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        Entry *entry = new (pool->allocate(sizeof(Entry))) Entry();
+        TreeList single(trees.get_allocator());
+        single.emplace_back(entry, trees.get_allocator(), std::forward<Args>(args)...);
+        meld(BinomialHeap(std::move(single), less));
+        return HeapHandle(entry);
     }
 
-    virtual void extractMin() override {
-        assert(checkInvariant());
-        assert(!trees.empty());
-        tree_iter minTree = trees.begin();
-        for (tree_iter curr = trees.begin(); curr != trees.end(); curr++)
-            if (curr->key < minTree->key)
-                minTree = curr;
-        TreeList children = std::move(minTree->children);
-        trees.erase(minTree);
-        meld(BinomialHeap(std::move(children)));
+    void extractMin() {
+        removeRoot(minRoot());
+    }
+
+    // extractMin that moves the key out
+    T pop() {
+        tree_iter root = minRoot();
+        T key = std::move(root->key);
+        removeRoot(root);
+        return key;
+    }
+
+    // O(log n): the key is swapped up towards the root
+    void decreaseKey(HeapHandle handle, T newKey) {
+        BinomialTree *tree = handle.as<Entry>()->tree;
+        assert(!less(tree->key, newKey));
+        tree->key = std::move(newKey);
+        siftUp(tree, false);
+    }
+
+    // the key goes all the way up, then its tree is split like in extractMin
+    void erase(HeapHandle handle) {
+        BinomialTree *root = siftUp(handle.as<Entry>()->tree, true);
+        tree_iter curr = trees.begin();
+        while (&*curr != root)
+            curr++;
+        removeRoot(curr);
     }
 
-    virtual bool empty() const override {
+    bool empty() const {
         return trees.empty();
     }
 };
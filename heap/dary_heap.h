@@ -0,0 +1,236 @@
+#pragma once
+#ifndef DARY_HEAP_H_INCLUDED
+#define DARY_HEAP_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cstring>
+
+#ifdef __SSE4_1__
+#include <smmintrin.h>
+#endif
+
+#include "heap.h"
+
+
+// Position of the smallest of keys[0, count), count <= D.
+template <typename T, size_t D, typename Compare = std::less<T>,
+          bool Arithmetic = std::is_arithmetic<T>::value && std::is_same<Compare, std::less<T>>::value>
+struct MinOfChildren {
+    static size_t find(const T *keys, size_t count, const Compare &less = Compare()) {
+        size_t best = 0;
+        for (size_t i = 1; i < count; i++)
+            if (less(keys[i], keys[best]))
+                best = i;
+        return best;
+    }
+};
+
+// Smallest of keys[0, D) for arithmetic T, as a pairwise tree: every
+// level is one packed min where the target has one for T, and the
+// compiler vectorizes it.
+template <typename T, size_t D, bool Packed = (D % 4 == 0)>
+struct MinReduce {
+    static T reduce(const T *keys) {
+        T lo[D];
+        std::copy(keys, keys + D, lo);
+        size_t width = D;
+        for (; width > 1; width = (width + 1) / 2)
+            for (size_t i = 0; i < width / 2; i++)
+                lo[i] = (lo[i + (width + 1) / 2] < lo[i] ? lo[i + (width + 1) / 2] : lo[i]);
+        return lo[0];
+    }
+};
+
+#ifdef __SSE4_1__
+// Four 32-bit lanes per instruction, with no reliance on the vectorizer.
+template <typename T, typename Load, typename Min>
+T reduce4Lanes(const T *keys, size_t count, Load load, Min min) {
+    __m128i lo = load(keys);
+    for (size_t i = 4; i < count; i += 4)
+        lo = min(lo, load(keys + i));
+    lo = min(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+    lo = min(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+    T result;
+    std::memcpy(&result, &lo, sizeof(T));
+    return result;
+}
+
+inline __m128i loadLanes(const void *keys) {
+    return _mm_loadu_si128(static_cast<const __m128i*>(keys));
+}
+
+template <size_t D>
+struct MinReduce<int, D, true> {
+    static int reduce(const int *keys) {
+        return reduce4Lanes(keys, D, loadLanes, [](__m128i a, __m128i b) {return _mm_min_epi32(a, b);});
+    }
+};
+
+template <size_t D>
+struct MinReduce<unsigned, D, true> {
+    static unsigned reduce(const unsigned *keys) {
+        return reduce4Lanes(keys, D, loadLanes, [](__m128i a, __m128i b) {return _mm_min_epu32(a, b);});
+    }
+};
+
+template <size_t D>
+struct MinReduce<float, D, true> {
+    static float reduce(const float *keys) {
+        return reduce4Lanes(keys, D, loadLanes, [](__m128i a, __m128i b) {
+            return _mm_castps_si128(_mm_min_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+        });
+    }
+};
+#endif // #ifdef __SSE4_1__
+
+// For arithmetic keys in the natural order a full group of D children is
+// reduced to its minimum value without branches, and a second scan finds
+// where it is. The last, partial group takes the plain scan.
+template <typename T, size_t D, typename Compare>
+struct MinOfChildren<T, D, Compare, true> {
+    static size_t find(const T *keys, size_t count, const Compare &less = Compare()) {
+        if (count < D)
+            return MinOfChildren<T, D, Compare, false>::find(keys, count, less);
+
+        const T lo = MinReduce<T, D>::reduce(keys);
+        size_t pos = 0;
+        while (pos + 1 < D && !(keys[pos] == lo))
+            pos++;
+        return pos;
+    }
+};
+
+
+// Implicit D-ary heap in one array: the children of i are
+// D * i + 1 ... D * i + D. A larger D makes the tree shallower and keeps
+// the children of a node in one or two cache lines, at the cost of more
+// comparisons per level of sift-down.
+template <typename T, size_t D = 4, typename Compare = std::less<T>>
+class DaryHeap {
+    static_assert(D >= 2, "a heap needs at least two children per node");
+
+private:
+    std::vector<T> data;
+    Compare less;
+
+    static size_t parent(size_t i) {return (i - 1) / D;}
+    static size_t firstChild(size_t i) {return D * i + 1;}
+
+    void siftUp(size_t i) {
+        T key = std::move(data[i]);
+        while (i > 0 && less(key, data[parent(i)])) {
+            data[i] = std::move(data[parent(i)]);
+            i = parent(i);
+        }
+        data[i] = std::move(key);
+    }
+
+    void siftDown(size_t i) {
+        const size_t size = data.size();
+        T key = std::move(data[i]);
+        while (firstChild(i) < size) {
+            size_t first = firstChild(i);
+            size_t child = first + MinOfChildren<T, D, Compare>::find(&data[first], std::min(D, size - first),
+                                                                      less);
+            if (!less(data[child], key))
+                break;
+            data[i] = std::move(data[child]);
+            i = child;
+        }
+        data[i] = std::move(key);
+    }
+
+    // bottom-up, O(size)
+    void heapify() {
+        if (data.size() < 2) return;
+        for (size_t i = parent(data.size() - 1) + 1; i-- > 0; )
+            siftDown(i);
+    }
+
+    static size_t depth(size_t size) {
+        size_t levels = 0;
+        for (size_t width = 1; size > 0; width *= D, levels++)
+            size -= std::min(size, width);
+        return levels;
+    }
+
+public:
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    explicit DaryHeap(const Compare &less = Compare()): data(), less(less) {}
+
+    template <typename InputIt>
+    DaryHeap(InputIt first, InputIt last, const Compare &less = Compare()): data(first, last), less(less) {
+        heapify();
+    }
+
+    const T& getMin() const {
+        assert(!data.empty());
+        return data[0];
+    }
+
+    // Appends the smaller array to the larger one. It is then either
+    // sifted up key by key or, when that would cost more than rebuilding,
+    // the combined array is heapified in linear time.
+    void meld(DaryHeap &&other) {
+        if (this == &other) return;
+        if (data.size() < other.data.size())
+            data.swap(other.data);
+
+        const size_t oldSize = data.size();
+        const size_t added = other.data.size();
+        data.insert(data.end(), std::make_move_iterator(other.data.begin()),
+                                std::make_move_iterator(other.data.end()));
+        other.data.clear();
+
+        if (added * depth(data.size()) < data.size()) {
+            for (size_t i = oldSize; i < data.size(); i++)
+                siftUp(i);
+        } else {
+            heapify();
+        }
+    }
+
+    // elements move around the array, so there are no handles
+    HeapHandle insert(T key) {
+        return emplace(std::move(key));
+    }
+
+    // the key is constructed at the end of the array, then moved up
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        data.emplace_back(std::forward<Args>(args)...);
+        siftUp(data.size() - 1);
+        return HeapHandle();
+    }
+
+    void extractMin() {
+        assert(!data.empty());
+        data[0] = std::move(data.back());
+        data.pop_back();
+        if (!data.empty())
+            siftDown(0);
+    }
+
+    // extractMin that moves the key out
+    T pop() {
+        assert(!data.empty());
+        T key = std::move(data[0]);
+        extractMin();
+        return key;
+    }
+
+    bool empty() const {
+        return data.empty();
+    }
+};
+
+#endif // #ifndef DARY_HEAP_H_INCLUDED
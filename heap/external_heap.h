@@ -0,0 +1,303 @@
+#pragma once
+#ifndef EXTERNAL_HEAP_H_INCLUDED
+#define EXTERNAL_HEAP_H_INCLUDED
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "heap.h"
+#include "dary_heap.h"
+
+
+// External-memory priority queue for more keys than fit in memory, after
+// sequence heaps: inserts go to an in-memory DaryHeap, and when that holds
+// its share of the memory budget it is written out as one sorted run to an
+// unlinked temporary file. The minimum is the lesser of the buffer's and
+// the least head of the runs, which are merged through a second DaryHeap as
+// they are read back block by block. Runs are kept in levels: when a level
+// holds `fanout` runs, they are merged into one run of the next level, so
+// each key is written O(log_fanout(n / buffer)) times.
+//
+// Half of memoryBytes is for the buffer, half for the I/O blocks, one per
+// run: the fanout is chosen so that kLevels levels of runs fit, and more
+// levels (only for inputs of fanout^kLevels buffers) go over the budget.
+// T must be trivially copyable, as it goes to disk as bytes. I/O errors are
+// thrown as std::system_error; handles are null.
+//
+// The run files go to directory, which must be on disk: on tmpfs, which
+// /tmp often is, the runs stay in RAM. The default, /var/tmp, is on disk on
+// most systems.
+template <typename T, typename Compare = std::less<T>>
+class ExternalHeap {
+    static_assert(std::is_trivially_copyable<T>::value, "keys are written to disk as bytes");
+
+private:
+    static const size_t kMaxBlockBytes = static_cast<size_t>(1) << 16;
+    static const size_t kLevels = 4; // runs per level are sized for this many levels
+
+    static std::system_error ioError(int err, const std::string &what) {
+        return std::system_error(err, std::generic_category(), what);
+    }
+
+    // A sorted run in its own file, read one block at a time.
+    struct Run {
+        int fd;
+        size_t size;  // keys in the file
+        size_t read;  // keys read from the file so far
+        size_t level;
+        std::vector<T> block;
+        size_t next;  // the head of the run in block
+
+        Run(int fd, size_t size, size_t level): fd(fd), size(size), read(0), level(level), block(), next(0) {}
+
+        ~Run() {
+            close(fd);
+        }
+
+        bool empty() const {return next == block.size() && read == size;}
+        const T& head() const {return block[next];}
+    };
+
+    struct Head {
+        T key;
+        Run *run;
+    };
+
+    struct HeadLess {
+        Compare less;
+        bool operator()(const Head &a, const Head &b) const {return less(a.key, b.key);}
+    };
+
+    typedef DaryHeap<Head, 4, HeadLess> HeadHeap;
+
+    int createFile() const {
+        std::string path = directory + "/heap-run-XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+        int fd = mkstemp(name.data());
+        if (fd < 0)
+            throw ioError(errno, "cannot create a run file in " + directory);
+        unlink(name.data()); // gone when closed
+        return fd;
+    }
+
+    static void writeKeys(int fd, const T *keys, size_t count, size_t at) {
+        const char *bytes = reinterpret_cast<const char*>(keys);
+        const size_t total = count * sizeof(T);
+        for (size_t done = 0; done < total; ) {
+            ssize_t written = pwrite(fd, bytes + done, total - done, at * sizeof(T) + done);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0)
+                throw ioError(errno, "cannot write a run file");
+            done += static_cast<size_t>(written);
+        }
+    }
+
+    void refill(Run &run) const {
+        size_t count = std::min(blockKeys, run.size - run.read);
+        run.block.resize(count);
+        char *bytes = reinterpret_cast<char*>(run.block.data());
+        const size_t total = count * sizeof(T);
+        for (size_t done = 0; done < total; ) {
+            ssize_t got = pread(run.fd, bytes + done, total - done, run.read * sizeof(T) + done);
+            if (got < 0 && errno == EINTR)
+                continue;
+            if (got <= 0)
+                throw ioError(got < 0 ? errno : EIO, "cannot read a run file");
+            done += static_cast<size_t>(got);
+        }
+        run.read += count;
+        run.next = 0;
+    }
+
+    // Moves past the head; false when the run is done.
+    bool advance(Run &run) const {
+        if (++run.next == run.block.size() && run.read < run.size)
+            refill(run);
+        return !run.empty();
+    }
+
+    // Writes the keys that next() yields, in order, into a new run.
+    template <typename Next>
+    void writeRun(size_t count, size_t level, Next next) {
+        std::unique_ptr<Run> run(new Run(createFile(), count, level));
+        run->block.resize(std::min(blockKeys, count));
+        for (size_t done = 0; done < count; ) {
+            size_t chunk = std::min(blockKeys, count - done);
+            for (size_t i = 0; i < chunk; i++)
+                run->block[i] = next();
+            writeKeys(run->fd, run->block.data(), chunk, done);
+            done += chunk;
+        }
+        refill(*run);
+        runs.push_back(std::move(run));
+    }
+
+    void rebuildHeads() {
+        std::vector<Head> fronts;
+        for (const std::unique_ptr<Run> &run : runs)
+            fronts.push_back(Head{run->head(), run.get()});
+        heads = HeadHeap(fronts.begin(), fronts.end(), HeadLess{less});
+    }
+
+    void dropRun(Run *run) {
+        for (size_t i = 0; i < runs.size(); i++) {
+            if (runs[i].get() == run) {
+                runs.erase(runs.begin() + i);
+                return;
+            }
+        }
+    }
+
+    // Merges all runs of a level into one of the next level.
+    void mergeLevel(size_t level) {
+        HeadHeap merging(HeadLess{less});
+        size_t keys = 0;
+        for (const std::unique_ptr<Run> &run : runs) {
+            if (run->level == level) {
+                merging.insert(Head{run->head(), run.get()});
+                keys += run->size - run->read + run->block.size() - run->next;
+            }
+        }
+        writeRun(keys, level + 1, [&]() {
+            Head head = merging.pop();
+            if (advance(*head.run))
+                merging.insert(Head{head.run->head(), head.run});
+            return head.key;
+        });
+        for (size_t i = runs.size(); i-- > 0; )
+            if (runs[i]->level == level)
+                runs.erase(runs.begin() + i);
+    }
+
+    // The buffer becomes a run of level 0; full levels are merged upwards.
+    void flush() {
+        writeRun(buffered, 0, [&]() {return buffer.pop();});
+        buffered = 0;
+        for (size_t level = 0; ; level++) {
+            size_t atLevel = 0;
+            for (const std::unique_ptr<Run> &run : runs)
+                atLevel += (run->level == level);
+            if (atLevel < fanout)
+                break;
+            mergeLevel(level);
+        }
+        rebuildHeads();
+    }
+
+    bool minInBuffer() const {
+        return heads.empty() || (buffered > 0 && !less(heads.getMin().key, buffer.getMin()));
+    }
+
+    std::string directory;
+    size_t bufferKeys;  // flushed at this many
+    size_t blockKeys;
+    size_t fanout;
+    DaryHeap<T, 4, Compare> buffer;
+    size_t buffered;
+    std::vector<std::unique_ptr<Run>> runs;
+    HeadHeap heads;     // the head of every run
+    size_t count;
+    Compare less;
+
+public:
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    explicit ExternalHeap(size_t memoryBytes = static_cast<size_t>(64) << 20,
+                          const std::string &directory = "/var/tmp", const Compare &less = Compare()):
+            directory(directory), bufferKeys(std::max<size_t>(memoryBytes / 2 / sizeof(T), 1)),
+            blockKeys(std::max<size_t>(std::min(static_cast<size_t>(kMaxBlockBytes),
+                                                memoryBytes / 2 / (2 * kLevels)) / sizeof(T), 1)),
+            fanout(std::max<size_t>(memoryBytes / 2 / (blockKeys * sizeof(T)) / kLevels, 2)),
+            buffer(less), buffered(0), runs(), heads(HeadLess{less}), count(0), less(less) {}
+
+    // the other heap is left empty, with no runs
+    ExternalHeap(ExternalHeap &&other):
+            directory(other.directory), bufferKeys(other.bufferKeys), blockKeys(other.blockKeys),
+            fanout(other.fanout), buffer(std::move(other.buffer)), buffered(other.buffered),
+            runs(std::move(other.runs)), heads(std::move(other.heads)), count(other.count), less(other.less) {
+        other.buffered = 0;
+        other.runs.clear();
+        other.count = 0;
+    }
+
+    ExternalHeap(const ExternalHeap&) = delete;
+    ExternalHeap& operator=(const ExternalHeap&) = delete;
+
+    const T& getMin() const {
+        assert(count > 0);
+        return (minInBuffer() ? buffer.getMin() : heads.getMin().key);
+    }
+
+    // the other heap is drained into this one
+    void meld(ExternalHeap &&other) {
+        if (this == &other) return;
+        while (!other.empty())
+            insert(other.pop());
+    }
+
+    HeapHandle insert(T key) {
+        if (buffered == bufferKeys)
+            flush();
+        buffer.insert(std::move(key));
+        buffered++;
+        count++;
+        return HeapHandle();
+    }
+
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        return insert(T(std::forward<Args>(args)...));
+    }
+
+    void extractMin() {
+        assert(count > 0);
+        count--;
+        if (minInBuffer()) {
+            buffer.extractMin();
+            buffered--;
+            return;
+        }
+        Head head = heads.pop();
+        if (advance(*head.run))
+            heads.insert(Head{head.run->head(), head.run});
+        else
+            dropRun(head.run);
+    }
+
+    T pop() {
+        T key = getMin();
+        extractMin();
+        return key;
+    }
+
+    bool empty() const {
+        return (count == 0);
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // runs on disk right now
+    size_t runCount() const {
+        return runs.size();
+    }
+};
+
+#endif // #ifndef EXTERNAL_HEAP_H_INCLUDED
@@ -0,0 +1,267 @@
+#pragma once
+#ifndef FIBONACCI_HEAP_H_INCLUDED
+#define FIBONACCI_HEAP_H_INCLUDED
+
+#include <cassert>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+
+// Fibonacci heap: a circular list of heap-ordered trees with a pointer to
+// the minimal root. insert and meld only add to the root list and
+// decreaseKey cuts the element off its parent (and cascades through parents
+// that already lost a child), all O(1) amortized; extractMin links the
+// roots by degree, amortized O(log n).
+template <typename T, typename Compare = std::less<T>>
+class FibonacciHeap {
+private:
+    struct FibonacciTree {
+        T key;
+        FibonacciTree *parent;
+        FibonacciTree *child;  // any of the children
+        FibonacciTree *left;   // siblings, circular
+        FibonacciTree *right;
+        size_t degree;
+        bool marked;           // lost a child since it became a child itself
+
+        template <typename... Args>
+        explicit FibonacciTree(Args&&... args): key(std::forward<Args>(args)...), parent(nullptr), child(nullptr),
+                                                left(this), right(this), degree(0), marked(false) {}
+    };
+
+    // joins two circular lists
+    static void splice(FibonacciTree *a, FibonacciTree *b) {
+        FibonacciTree *aRight = a->right;
+        FibonacciTree *bLeft = b->left;
+        a->right = b;
+        b->left = a;
+        bLeft->right = aRight;
+        aRight->left = bLeft;
+    }
+
+    static void unlink(FibonacciTree *tree) {
+        tree->left->right = tree->right;
+        tree->right->left = tree->left;
+        tree->left = tree->right = tree;
+    }
+
+    // no recursion: cascading cuts can leave long chains
+    static void deleteTrees(FibonacciTree *list) {
+        std::vector<FibonacciTree*> stack;
+        if (list != nullptr)
+            stack.push_back(list);
+        while (!stack.empty()) {
+            FibonacciTree *tree = stack.back();
+            stack.pop_back();
+            tree->left->right = nullptr;
+            while (tree != nullptr) {
+                FibonacciTree *next = tree->right;
+                if (tree->child != nullptr)
+                    stack.push_back(tree->child);
+                delete tree;
+                tree = next;
+            }
+        }
+    }
+
+    void addRoot(FibonacciTree *tree) {
+        tree->parent = nullptr;
+        tree->marked = false;
+        if (min == nullptr) {
+            min = tree;
+            return;
+        }
+        splice(min, tree);
+        if (less(tree->key, min->key))
+            min = tree;
+    }
+
+    // makes root child a child of root parent
+    static void link(FibonacciTree *child, FibonacciTree *parent) {
+        unlink(child);
+        child->parent = parent;
+        child->marked = false;
+        if (parent->child == nullptr)
+            parent->child = child;
+        else
+            splice(parent->child, child);
+        parent->degree++;
+    }
+
+    // links roots of equal degree until all degrees differ
+    void consolidate() {
+        std::vector<FibonacciTree*> roots;
+        FibonacciTree *tree = min;
+        do {
+            roots.push_back(tree);
+            tree = tree->right;
+        } while (tree != min);
+
+        std::vector<FibonacciTree*> byDegree;
+        for (FibonacciTree *root : roots) {
+            size_t degree = root->degree;
+            while (degree < byDegree.size() && byDegree[degree] != nullptr) {
+                FibonacciTree *other = byDegree[degree];
+                if (less(other->key, root->key))
+                    std::swap(root, other);
+                link(other, root);
+                byDegree[degree++] = nullptr;
+            }
+            if (degree >= byDegree.size())
+                byDegree.resize(degree + 1, nullptr);
+            byDegree[degree] = root;
+        }
+
+        min = nullptr;
+        for (FibonacciTree *root : byDegree)
+            if (root != nullptr && (min == nullptr || less(root->key, min->key)))
+                min = root;
+    }
+
+    // moves tree from the children of parent to the roots
+    void cut(FibonacciTree *tree, FibonacciTree *parent) {
+        if (tree->right == tree) {
+            parent->child = nullptr;
+        } else {
+            if (parent->child == tree)
+                parent->child = tree->right;
+            unlink(tree);
+        }
+        parent->degree--;
+        addRoot(tree);
+    }
+
+    void cascadingCut(FibonacciTree *tree) {
+        while (tree->parent != nullptr) {
+            if (!tree->marked) {
+                tree->marked = true;
+                return;
+            }
+            FibonacciTree *parent = tree->parent;
+            cut(tree, parent);
+            tree = parent;
+        }
+    }
+
+    FibonacciTree *min;
+    Compare less;
+
+public:
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    FibonacciHeap(FibonacciHeap &&other): min(other.min), less(other.less) {
+        other.min = nullptr;
+    }
+
+    FibonacciHeap(const FibonacciHeap&) = delete;
+    FibonacciHeap& operator=(const FibonacciHeap &other) = delete;
+
+    explicit FibonacciHeap(const Compare &less = Compare()): min(nullptr), less(less) {}
+
+    // O(n): the keys only go to the root list, the first extractMin links them
+    template <typename InputIt>
+    FibonacciHeap(InputIt first, InputIt last, const Compare &less = Compare()): min(nullptr), less(less) {
+        for (; first != last; ++first)
+            addRoot(new FibonacciTree(*first));
+    }
+
+    ~FibonacciHeap() {
+        deleteTrees(min);
+        min = nullptr;
+    }
+
+    const T& getMin() const {
+        assert(min != nullptr);
+        return min->key;
+    }
+
+    void meld(FibonacciHeap &&other) {
+        if (this == &other || other.min == nullptr) return;
+        if (min == nullptr) {
+            min = other.min;
+        } else {
+            splice(min, other.min);
+            if (less(other.min->key, min->key))
+                min = other.min;
+        }
+        other.min = nullptr;
+    }
+
+    HeapHandle insert(T key) {
+        return emplace(std::move(key));
+    }
+
+    // the key is constructed in its node
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        FibonacciTree *tree = new FibonacciTree(std::forward<Args>(args)...);
+        addRoot(tree);
+        return HeapHandle(tree);
+    }
+
+    // extractMin that moves the key out
+    T pop() {
+        assert(min != nullptr);
+        T key = std::move(min->key);
+        extractMin();
+        return key;
+    }
+
+    void extractMin() {
+        assert(min != nullptr);
+        FibonacciTree *oldMin = min;
+        if (oldMin->child != nullptr) {
+            FibonacciTree *child = oldMin->child;
+            do {
+                child->parent = nullptr;
+                child->marked = false;
+                child = child->right;
+            } while (child != oldMin->child);
+            splice(oldMin, oldMin->child);
+        }
+
+        if (oldMin->right == oldMin) {
+            min = nullptr;
+        } else {
+            min = oldMin->right;
+            unlink(oldMin);
+            consolidate();
+        }
+        delete oldMin;
+    }
+
+    void decreaseKey(HeapHandle handle, T newKey) {
+        FibonacciTree *tree = handle.as<FibonacciTree>();
+        assert(!less(tree->key, newKey));
+        tree->key = std::move(newKey);
+        FibonacciTree *parent = tree->parent;
+        if (parent != nullptr && less(tree->key, parent->key)) {
+            cut(tree, parent);
+            cascadingCut(parent);
+        }
+        if (less(tree->key, min->key))
+            min = tree;
+    }
+
+    // as if the key dropped below all others, then extractMin
+    void erase(HeapHandle handle) {
+        FibonacciTree *tree = handle.as<FibonacciTree>();
+        FibonacciTree *parent = tree->parent;
+        if (parent != nullptr) {
+            cut(tree, parent);
+            cascadingCut(parent);
+        }
+        min = tree;
+        extractMin();
+    }
+
+    bool empty() const {
+        return (min == nullptr);
+    }
+};
+
+#endif // #ifndef FIBONACCI_HEAP_H_INCLUDED
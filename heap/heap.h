@@ -2,18 +2,152 @@
 #ifndef HEAP_H_INCLUDED
 #define HEAP_H_INCLUDED
 
+#include <utility>
+
+// Stable reference to an element of a heap, returned by insert. It stays
+// valid across melds, until the element is extracted or erased. Heaps that
+// cannot address their elements return a null handle.
+class HeapHandle {
+private:
+    void *ptr;
+
+public:
+    HeapHandle(): ptr(nullptr) {}
+    explicit HeapHandle(void *ptr): ptr(ptr) {}
+
+    bool null() const {return ptr == nullptr;}
+
+    template <typename Node>
+    Node* as() const {return static_cast<Node*>(ptr);}
+};
+
+
+// The heaps are plain class templates, called directly and inlined; each is
+// a model of this compile-time interface, with no virtual functions:
+//
+//   template <typename T, typename Compare = std::less<T>> class Heap {
+//       typedef T value_type;
+//       typedef Compare value_compare;
+//       Heap(const Compare& = Compare());
+//       Heap(Heap&&);
+//       HeapHandle insert(T key);      // keys are moved in, may be move-only
+//       HeapHandle emplace(Args&&...); // the key constructed in place
+//       const T& getMin() const;       // the least key by Compare
+//       void extractMin();
+//       T pop();                       // extractMin, moving the key out
+//       void meld(Heap &&other);       // takes all keys of other
+//       bool empty() const;
+//   };
+//
+// Addressable heaps also have
+//
+//       void decreaseKey(HeapHandle, T newKey); // newKey not greater
+//       void erase(HeapHandle);
+//
+// IHeap and IAddressableHeap put a vtable over any of them, see HeapAdapter.
+
+
+// Moves all keys of a heap of another type into a heap, one by one.
+template <typename HeapA, typename HeapB>
+void meld(HeapA &heap, HeapB &&other) {
+    while (!other.empty())
+        heap.insert(other.pop());
+}
+
+// Heaps of one type meld natively.
+template <typename HeapT>
+void meld(HeapT &heap, HeapT &&other) {
+    heap.meld(std::move(other));
+}
+
+
 template <typename T>
 class IHeap {
 public:
     virtual ~IHeap() = 0;
-    
-    virtual void insert(T) = 0;
+
+    virtual HeapHandle insert(T) = 0;
     virtual T getMin() const = 0;
     virtual void extractMin() = 0;
+    virtual T pop() = 0;
     virtual void meld(IHeap&&) = 0;
     virtual bool empty() const = 0;
 };
 
 template <typename T> IHeap<T>::~IHeap() {}
 
+// A heap whose handles can be used to change or remove its elements.
+template <typename T>
+class IAddressableHeap : public IHeap<T> {
+public:
+    // newKey must not be greater than the current key of the element
+    virtual void decreaseKey(HeapHandle, T newKey) = 0;
+    virtual void erase(HeapHandle) = 0;
+};
+
+
+// Type erasure for code that picks the heap at run time: a heap behind
+// IHeap, or IAddressableHeap when Interface says so. Adapters of the same
+// heap type meld natively; any other IHeap is drained into this one.
+template <typename HeapT, typename Interface = IHeap<typename HeapT::value_type>>
+class HeapAdapter : public Interface {
+protected:
+    typedef typename HeapT::value_type T;
+
+    HeapT heap;
+
+public:
+    template <typename... Args>
+    explicit HeapAdapter(Args&&... args): heap(std::forward<Args>(args)...) {}
+
+    HeapT& get() {return heap;}
+    const HeapT& get() const {return heap;}
+
+    virtual HeapHandle insert(T key) override {
+        return heap.insert(std::move(key));
+    }
+
+    virtual T getMin() const override {
+        return heap.getMin();
+    }
+
+    virtual void extractMin() override {
+        heap.extractMin();
+    }
+
+    virtual T pop() override {
+        return heap.pop();
+    }
+
+    virtual void meld(IHeap<T> &&other) override {
+        if (HeapAdapter *same = dynamic_cast<HeapAdapter*>(&other))
+            heap.meld(std::move(same->heap));
+        else
+            ::meld(heap, std::move(other));
+    }
+
+    virtual bool empty() const override {
+        return heap.empty();
+    }
+};
+
+template <typename HeapT>
+class AddressableHeapAdapter : public HeapAdapter<HeapT, IAddressableHeap<typename HeapT::value_type>> {
+private:
+    typedef HeapAdapter<HeapT, IAddressableHeap<typename HeapT::value_type>> Base;
+    typedef typename Base::T T;
+
+public:
+    template <typename... Args>
+    explicit AddressableHeapAdapter(Args&&... args): Base(std::forward<Args>(args)...) {}
+
+    virtual void decreaseKey(HeapHandle handle, T newKey) override {
+        this->heap.decreaseKey(handle, std::move(newKey));
+    }
+
+    virtual void erase(HeapHandle handle) override {
+        this->heap.erase(handle);
+    }
+};
+
 #endif // #ifndef HEAP_H_INCLUDED
@@ -0,0 +1,219 @@
+#pragma once
+#ifndef HEAP_FOREST_H_INCLUDED
+#define HEAP_FOREST_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+#include "node_pool.h"
+
+
+// Many small mergeable heaps of one type, named by integer handles: the
+// heaps themselves sit in one array of slots, and a heap melded into
+// another or removed frees its slot for the next addHeap, all in O(1). A
+// handle carries the generation of its slot, so a handle of a freed heap is
+// told apart from the heap that reuses the slot (valid()). Heaps that take
+// a NodePool all share the forest's pool.
+//
+// With TrackOwners, elements also know their heap: every heap ever added is
+// a set of a union-find, meld unites the sets, and owner() finds the heap
+// an element is in now, in near O(1). decreaseKey and erase of elements go
+// through it; the sets of heaps melded away stay, a few words per heap ever
+// added. Without it, insert records nothing and meld does no unions.
+template <typename HeapT, bool TrackOwners = false>
+class HeapForest {
+public:
+    typedef typename HeapT::value_type value_type;
+    typedef uint64_t Handle; // generation << 32 | slot
+
+    // An inserted element: its handle in the heap and its union-find set.
+    struct Element {
+        HeapHandle handle;
+        size_t set;
+    };
+
+private:
+    typedef value_type T;
+
+    static const uint32_t kNoSlot = ~static_cast<uint32_t>(0);
+
+    struct Slot {
+        HeapT heap;
+        uint32_t generation; // odd while the slot holds a heap
+        uint32_t nextFree;
+        size_t set;          // of the heap, with TrackOwners
+    };
+
+    static Handle makeHandle(uint32_t slot, uint32_t generation) {
+        return (static_cast<Handle>(generation) << 32) | slot;
+    }
+
+    static uint32_t slotOf(Handle heap) {return static_cast<uint32_t>(heap);}
+    static uint32_t generationOf(Handle heap) {return static_cast<uint32_t>(heap >> 32);}
+
+    template <typename H = HeapT>
+    typename std::enable_if<std::is_constructible<H, std::shared_ptr<NodePool>>::value, H>::type newHeap() const {
+        return H(pool);
+    }
+
+    template <typename H = HeapT>
+    typename std::enable_if<!std::is_constructible<H, std::shared_ptr<NodePool>>::value, H>::type newHeap() const {
+        return H();
+    }
+
+    Slot& slot(Handle heap) {
+        assert(valid(heap));
+        return slots[slotOf(heap)];
+    }
+
+    const Slot& slot(Handle heap) const {
+        assert(valid(heap));
+        return slots[slotOf(heap)];
+    }
+
+    void freeSlot(uint32_t index) {
+        slots[index].generation++;
+        slots[index].nextFree = freeSlots;
+        freeSlots = index;
+        count--;
+    }
+
+    // union-find by rank with path halving; the root of a set names its heap
+    size_t find(size_t set) const {
+        while (parents[set] != set) {
+            parents[set] = parents[parents[set]];
+            set = parents[set];
+        }
+        return set;
+    }
+
+    size_t newSet(Handle heap) {
+        parents.push_back(parents.size());
+        ranks.push_back(0);
+        owners.push_back(heap);
+        return parents.size() - 1;
+    }
+
+    std::shared_ptr<NodePool> pool;
+    std::vector<Slot> slots;
+    uint32_t freeSlots; // a list through Slot::nextFree
+    size_t count;
+    mutable std::vector<size_t> parents;
+    std::vector<unsigned char> ranks;
+    std::vector<Handle> owners; // of root sets
+
+public:
+    HeapForest(): pool(std::make_shared<NodePool>()), slots(), freeSlots(kNoSlot), count(0), parents(), ranks(),
+                  owners() {}
+
+    HeapForest(const HeapForest&) = delete;
+    HeapForest& operator=(const HeapForest&) = delete;
+
+    // O(1), amortized over the growth of the slot array
+    Handle addHeap() {
+        uint32_t index = freeSlots;
+        if (index == kNoSlot) {
+            assert(slots.size() < kNoSlot);
+            index = static_cast<uint32_t>(slots.size());
+            slots.push_back(Slot{newHeap(), 0, kNoSlot, 0});
+        } else {
+            freeSlots = slots[index].nextFree;
+        }
+        Slot &added = slots[index];
+        added.generation++;
+        count++;
+        Handle heap = makeHandle(index, added.generation);
+        if (TrackOwners)
+            added.set = newSet(heap);
+        return heap;
+    }
+
+    // false for heaps melded away or removed
+    bool valid(Handle heap) const {
+        return slotOf(heap) < slots.size() && slots[slotOf(heap)].generation == generationOf(heap) &&
+               (generationOf(heap) & 1);
+    }
+
+    // Frees the slot of a heap; keys still in it are destroyed. An empty
+    // heap stays in the slot as it is, for the next addHeap.
+    void removeHeap(Handle heap) {
+        Slot &removed = slot(heap);
+        if (!removed.heap.empty()) {
+            removed.heap.~HeapT();
+            new (&removed.heap) HeapT(newHeap());
+        }
+        freeSlot(slotOf(heap));
+    }
+
+    Element insert(Handle heap, T key) {
+        Slot &target = slot(heap);
+        return Element{target.heap.insert(std::move(key)), (TrackOwners ? target.set : 0)};
+    }
+
+    const T& getMin(Handle heap) const {
+        return slot(heap).heap.getMin();
+    }
+
+    void extractMin(Handle heap) {
+        slot(heap).heap.extractMin();
+    }
+
+    T pop(Handle heap) {
+        return slot(heap).heap.pop();
+    }
+
+    bool empty(Handle heap) const {
+        return slot(heap).heap.empty();
+    }
+
+    // The keys of other go to heap, and other is invalid from now on.
+    void meld(Handle heap, Handle other) {
+        if (heap == other) return;
+        Slot &target = slot(heap);
+        Slot &source = slot(other);
+        ::meld(target.heap, std::move(source.heap));
+        if (TrackOwners) {
+            size_t set = find(target.set);
+            size_t merged = find(source.set);
+            if (ranks[set] < ranks[merged])
+                std::swap(set, merged);
+            parents[merged] = set;
+            ranks[set] += (ranks[set] == ranks[merged]);
+            owners[set] = heap;
+            target.set = set;
+        }
+        freeSlot(slotOf(other));
+    }
+
+    // the heap the element is in now
+    Handle owner(const Element &element) const {
+        static_assert(TrackOwners, "owner() needs a HeapForest that tracks owners");
+        return owners[find(element.set)];
+    }
+
+    void decreaseKey(const Element &element, T newKey) {
+        slot(owner(element)).heap.decreaseKey(element.handle, std::move(newKey));
+    }
+
+    void erase(const Element &element) {
+        slot(owner(element)).heap.erase(element.handle);
+    }
+
+    // heaps in the forest
+    size_t size() const {
+        return count;
+    }
+
+    HeapT& get(Handle heap) {
+        return slot(heap).heap;
+    }
+};
+
+#endif // #ifndef HEAP_FOREST_H_INCLUDED
@@ -0,0 +1,256 @@
+#pragma once
+#ifndef LAZY_BINOMIAL_HEAP_H_INCLUDED
+#define LAZY_BINOMIAL_HEAP_H_INCLUDED
+
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "heap.h"
+#include "node_pool.h"
+
+
+// Binomial heap with lazy insert and meld: new trees are only put into the
+// root list, and extractMin links roots of equal degree until all degrees
+// differ, like a Fibonacci heap without cuts. The minimal root is cached, so
+// getMin is O(1); insert and meld are O(1), extractMin is amortized
+// O(log n). Trees use intrusive child / sibling links; nodes and entries
+// come from a NodePool. BinomialHeap is the eager variant.
+template <typename T, typename Compare = std::less<T>>
+class LazyBinomialHeap {
+private:
+    struct BinomialTree;
+
+    // What a handle points to: decreaseKey moves keys up the tree, and the
+    // entry of a key moves along with it.
+    struct Entry {
+        BinomialTree *tree;
+    };
+
+    struct BinomialTree {
+        T key;
+        Entry *entry;
+        BinomialTree *parent;
+        BinomialTree *child;   // the child of the highest degree
+        BinomialTree *sibling; // next root, or next child of lower degree
+        size_t degree;
+
+        template <typename... Args>
+        explicit BinomialTree(Entry *entry, Args&&... args): key(std::forward<Args>(args)...), entry(entry),
+                                                             parent(nullptr), child(nullptr), sibling(nullptr),
+                                                             degree(0) {
+            entry->tree = this;
+        }
+    };
+
+    // a tree of degree d has 2^d nodes
+    static const size_t kMaxDegree = 8 * sizeof(size_t);
+
+    template <typename... Args>
+    BinomialTree* newTree(Args&&... args) {
+        Entry *entry = new (pool->allocate(sizeof(Entry))) Entry();
+        return new (pool->allocate(sizeof(BinomialTree))) BinomialTree(entry, std::forward<Args>(args)...);
+    }
+
+    void deleteNode(BinomialTree *tree) {
+        pool->deallocate(tree->entry, sizeof(Entry));
+        tree->~BinomialTree();
+        pool->deallocate(tree, sizeof(BinomialTree));
+    }
+
+    // recursion only as deep as the degrees
+    void deleteTrees(BinomialTree *list) {
+        while (list != nullptr) {
+            BinomialTree *next = list->sibling;
+            deleteTrees(list->child);
+            deleteNode(list);
+            list = next;
+        }
+    }
+
+    void addRoot(BinomialTree *tree) {
+        tree->parent = nullptr;
+        tree->sibling = nullptr;
+        if (first == nullptr) {
+            first = last = min = tree;
+            return;
+        }
+        last->sibling = tree;
+        last = tree;
+        if (less(tree->key, min->key))
+            min = tree;
+    }
+
+    // both roots of equal degree; the greater one becomes a child of the other
+    BinomialTree* link(BinomialTree *a, BinomialTree *b) {
+        if (less(b->key, a->key))
+            std::swap(a, b);
+        b->parent = a;
+        b->sibling = a->child;
+        a->child = b;
+        a->degree++;
+        return a;
+    }
+
+    void placeByDegree(BinomialTree **byDegree, BinomialTree *tree) {
+        while (byDegree[tree->degree] != nullptr) {
+            BinomialTree *other = byDegree[tree->degree];
+            byDegree[tree->degree] = nullptr;
+            tree = link(tree, other);
+        }
+        byDegree[tree->degree] = tree;
+    }
+
+    // Takes a root out: its children and all other roots are linked by
+    // degree into the new root list.
+    void removeRoot(BinomialTree *root) {
+        BinomialTree *byDegree[kMaxDegree] = {};
+        BinomialTree *tree = first;
+        while (tree != nullptr) {
+            BinomialTree *next = tree->sibling;
+            if (tree != root)
+                placeByDegree(byDegree, tree);
+            tree = next;
+        }
+        tree = root->child;
+        while (tree != nullptr) {
+            BinomialTree *next = tree->sibling;
+            placeByDegree(byDegree, tree);
+            tree = next;
+        }
+        deleteNode(root);
+
+        first = last = min = nullptr;
+        for (BinomialTree *top : byDegree)
+            if (top != nullptr)
+                addRoot(top);
+    }
+
+    // Returns the tree the key ends up in: its root with toRoot,
+    // otherwise the first one with a parent that is not greater.
+    BinomialTree* siftUp(BinomialTree *tree, bool toRoot) {
+        while (tree->parent != nullptr && (toRoot || less(tree->key, tree->parent->key))) {
+            BinomialTree *parent = tree->parent;
+            std::swap(tree->key, parent->key);
+            std::swap(tree->entry, parent->entry);
+            tree->entry->tree = tree;
+            parent->entry->tree = parent;
+            tree = parent;
+        }
+        return tree;
+    }
+
+    std::shared_ptr<NodePool> pool;
+    BinomialTree *first; // root list
+    BinomialTree *last;
+    BinomialTree *min;
+    Compare less;
+
+public:
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    LazyBinomialHeap(LazyBinomialHeap &&other): pool(other.pool), first(other.first), last(other.last),
+                                                min(other.min), less(other.less) {
+        pool->attach();
+        other.first = other.last = other.min = nullptr;
+    }
+
+    LazyBinomialHeap(const LazyBinomialHeap&) = delete;
+    LazyBinomialHeap& operator=(const LazyBinomialHeap &other) = delete;
+
+    explicit LazyBinomialHeap(const Compare &less = Compare()):
+            LazyBinomialHeap(std::make_shared<NodePool>(), less) {}
+
+    explicit LazyBinomialHeap(std::shared_ptr<NodePool> pool, const Compare &less = Compare()):
+            pool(std::move(pool)), first(nullptr), last(nullptr), min(nullptr), less(less) {
+        this->pool->attach();
+    }
+
+    // O(n): the keys only go to the root list, the first extractMin links them
+    template <typename InputIt>
+    LazyBinomialHeap(InputIt first, InputIt last, std::shared_ptr<NodePool> pool = std::make_shared<NodePool>(),
+                     const Compare &less = Compare()): LazyBinomialHeap(std::move(pool), less) {
+        for (; first != last; ++first)
+            addRoot(newTree(*first));
+    }
+
+    ~LazyBinomialHeap() {
+        if (pool->detach() && std::is_trivially_destructible<T>::value)
+            pool->release();
+        else
+            deleteTrees(first);
+        first = last = min = nullptr;
+    }
+
+    const T& getMin() const {
+        assert(min != nullptr);
+        return min->key;
+    }
+
+    // O(1): the root lists are joined
+    void meld(LazyBinomialHeap &&other) {
+        if (this == &other || other.first == nullptr) return;
+        NodePool::merge(*pool, *other.pool);
+        if (first == nullptr) {
+            first = other.first;
+            last = other.last;
+            min = other.min;
+        } else {
+            last->sibling = other.first;
+            last = other.last;
+            if (less(other.min->key, min->key))
+                min = other.min;
+        }
+        other.first = other.last = other.min = nullptr;
+    }
+
+    HeapHandle insert(T key) {
+        return emplace(std::move(key));
+    }
+
+    // the key is constructed in its node
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        BinomialTree *tree = newTree(std::forward<Args>(args)...);
+        addRoot(tree);
+        return HeapHandle(tree->entry);
+    }
+
+    void extractMin() {
+        assert(min != nullptr);
+        removeRoot(min);
+    }
+
+    // extractMin that moves the key out
+    T pop() {
+        assert(min != nullptr);
+        T key = std::move(min->key);
+        removeRoot(min);
+        return key;
+    }
+
+    // O(log n): the key is swapped up towards the root
+    void decreaseKey(HeapHandle handle, T newKey) {
+        BinomialTree *tree = handle.as<Entry>()->tree;
+        assert(!less(tree->key, newKey));
+        tree->key = std::move(newKey);
+        tree = siftUp(tree, false);
+        if (less(tree->key, min->key))
+            min = tree;
+    }
+
+    // the key goes all the way up, then its tree is split like in extractMin
+    void erase(HeapHandle handle) {
+        removeRoot(siftUp(handle.as<Entry>()->tree, true));
+    }
+
+    bool empty() const {
+        return (min == nullptr);
+    }
+};
+
+#endif // #ifndef LAZY_BINOMIAL_HEAP_H_INCLUDED
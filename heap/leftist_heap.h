@@ -1,86 +1,226 @@
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "heap.h"
+#include "node_pool.h"
 
-template <typename T>
-class LeftistHeap : public IHeap<T> {
+template <typename T, typename Compare = std::less<T>>
+class LeftistHeap {
 private:
     struct LeftistTree {
         T key;
         LeftistTree *left;
         LeftistTree *right;
+        LeftistTree *parent;
         size_t dist;
 
-        LeftistTree(T key): key(key), left(nullptr), right(nullptr), dist(1) {}
+        template <typename... Args>
+        explicit LeftistTree(Args&&... args): key(std::forward<Args>(args)...),
+                                              left(nullptr), right(nullptr), parent(nullptr), dist(1) {}
     };
 
-    static void deleteTree(LeftistTree *tree) {
-        if (tree == nullptr) return;
-        deleteTree(tree->left);
-        deleteTree(tree->right);
-        delete tree;
+    template <typename... Args>
+    LeftistTree* newTree(Args&&... args) {
+        return new (pool->allocate(sizeof(LeftistTree))) LeftistTree(std::forward<Args>(args)...);
+    }
+
+    void deleteNode(LeftistTree *tree) {
+        tree->~LeftistTree();
+        pool->deallocate(tree, sizeof(LeftistTree));
+    }
+
+    // No recursion, no stack: a left child is rotated up until there is
+    // none, then the node goes. Sorted inserts leave chains of n nodes.
+    void deleteTree(LeftistTree *tree) {
+        while (tree != nullptr) {
+            LeftistTree *left = tree->left;
+            if (left != nullptr) {
+                tree->left = left->right;
+                left->right = tree;
+                tree = left;
+            } else {
+                LeftistTree *right = tree->right;
+                deleteNode(tree);
+                tree = right;
+            }
+        }
     }
 
     static size_t dist(const LeftistTree *tree) {
         return (tree == nullptr ? 0 : tree->dist);
     }
 
-    static LeftistTree* merge(LeftistTree *left, LeftistTree *right) {
-        if (left == nullptr) return right;
-        if (right == nullptr) return left;
-        assert(left != right);
+    // Top-down along the right spines, then back up the merged spine
+    // through the parent links swapping children and fixing distances.
+    // The result has no parent.
+    LeftistTree* merge(LeftistTree *left, LeftistTree *right) {
+        LeftistTree *result = nullptr;
+        LeftistTree **link = &result;
+        LeftistTree *parent = nullptr;
+        while (left != nullptr && right != nullptr) {
+            assert(left != right);
+            if (less(right->key, left->key))
+                std::swap(left, right);
+            *link = left;
+            left->parent = parent;
+            parent = left;
+            link = &left->right;
+            left = left->right;
+        }
+        *link = (left != nullptr ? left : right);
+        if (*link != nullptr)
+            (*link)->parent = parent;
+
+        for (; parent != nullptr; parent = parent->parent) {
+            if (dist(parent->left) < dist(parent->right))
+                std::swap(parent->left, parent->right);
+            parent->dist = dist(parent->right) + 1;
+        }
+        return result;
+    }
+
+    // O(n): singletons are merged pairwise, round by round
+    LeftistTree* mergeAll(std::vector<LeftistTree*> &trees) {
+        if (trees.empty()) return nullptr;
+        for (size_t count = trees.size(); count > 1; count = (count + 1) / 2)
+            for (size_t i = 0; i < count; i += 2)
+                trees[i / 2] = (i + 1 < count ? merge(trees[i], trees[i + 1]) : trees[i]);
+        return trees[0];
+    }
+
+    // Restores the leftist property on the way up from a node that lost a
+    // subtree; stops as soon as a distance does not change.
+    static void fixUp(LeftistTree *tree) {
+        for (; tree != nullptr; tree = tree->parent) {
+            if (dist(tree->left) < dist(tree->right))
+                std::swap(tree->left, tree->right);
+            size_t newDist = dist(tree->right) + 1;
+            if (newDist == tree->dist)
+                break;
+            tree->dist = newDist;
+        }
+    }
 
-        if (left->key > right->key)
-            std::swap(left, right);
+    // unlinks the subtree of tree from the heap
+    void detach(LeftistTree *tree) {
+        LeftistTree *parent = tree->parent;
+        if (parent == nullptr) {
+            root = nullptr;
+            return;
+        }
+        (parent->left == tree ? parent->left : parent->right) = nullptr;
+        tree->parent = nullptr;
+        fixUp(parent);
+    }
 
-        left->right = merge(left->right, right);
-        if (dist(left->left) < dist(left->right))
-            std::swap(left->left, left->right);
-        left->dist = std::min(dist(left->left), dist(right->right)) + 1;
-        return left;
+    void setRoot(LeftistTree *tree) {
+        root = tree;
+        if (root != nullptr)
+            root->parent = nullptr;
     }
 
+    std::shared_ptr<NodePool> pool;
     LeftistTree *root;
-    
+    Compare less;
+
 public:
-    LeftistHeap(LeftistHeap &&other): root(other.root) {
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    LeftistHeap(LeftistHeap &&other): pool(other.pool), root(other.root), less(other.less) {
+        pool->attach();
         other.root = nullptr;
     }
 
     LeftistHeap(const LeftistHeap&) = delete;
     LeftistHeap& operator=(const LeftistHeap &other) = delete;
 
-    LeftistHeap(): root(nullptr) {}
+    explicit LeftistHeap(const Compare &less = Compare()): LeftistHeap(std::make_shared<NodePool>(), less) {}
+
+    explicit LeftistHeap(std::shared_ptr<NodePool> pool, const Compare &less = Compare()):
+            pool(std::move(pool)), root(nullptr), less(less) {
+        this->pool->attach();
+    }
 
-    virtual ~LeftistHeap() {
-        deleteTree(root);
+    template <typename InputIt>
+    LeftistHeap(InputIt first, InputIt last, std::shared_ptr<NodePool> pool = std::make_shared<NodePool>(),
+            const Compare &less = Compare()): LeftistHeap(std::move(pool), less) {
+        std::vector<LeftistTree*> trees;
+        for (; first != last; ++first)
+            trees.push_back(newTree(*first));
+        setRoot(mergeAll(trees));
+    }
+
+    ~LeftistHeap() {
+        if (pool->detach() && std::is_trivially_destructible<T>::value)
+            pool->release();
+        else
+            deleteTree(root);
         root = nullptr;
     }
 
-    virtual T getMin() const override {
+    const T& getMin() const {
         assert(root != nullptr);
         return root->key;
     }
 
-    virtual void meld(IHeap<T> &&other) override {
-        meld(std::move(dynamic_cast<LeftistHeap&>(other)));
-    }
-
     void meld(LeftistHeap &&other) {
         if (this == &other) return;
-        root = merge(root, other.root);
+        NodePool::merge(*pool, *other.pool);
+        setRoot(merge(root, other.root));
         other.root = nullptr;
     }
 
-    virtual void insert(T key) override {
-        root = merge(root, new LeftistTree(key));
+    HeapHandle insert(T key) {
+        return emplace(std::move(key));
     }
 
-    virtual void extractMin() override {
+    // the key is constructed in its node
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        LeftistTree *tree = newTree(std::forward<Args>(args)...);
+        setRoot(merge(root, tree));
+        return HeapHandle(tree);
+    }
+
+    // extractMin that moves the key out
+    T pop() {
+        assert(root != nullptr);
+        T key = std::move(root->key);
+        extractMin();
+        return key;
+    }
+
+    void extractMin() {
         assert(root != nullptr);
         LeftistTree *oldRoot = root;
-        root = merge(root->left, root->right);
-        delete oldRoot;
+        setRoot(merge(root->left, root->right));
+        deleteNode(oldRoot);
+    }
+
+    // O(log n): the subtree of the element is cut off and merged back
+    void decreaseKey(HeapHandle handle, T newKey) {
+        LeftistTree *tree = handle.as<LeftistTree>();
+        assert(!less(tree->key, newKey));
+        tree->key = std::move(newKey);
+        if (tree->parent == nullptr || !less(tree->key, tree->parent->key))
+            return;
+        detach(tree);
+        setRoot(merge(root, tree));
+    }
+
+    void erase(HeapHandle handle) {
+        LeftistTree *tree = handle.as<LeftistTree>();
+        detach(tree);
+        LeftistTree *children = merge(tree->left, tree->right);
+        if (children != nullptr)
+            children->parent = nullptr;
+        setRoot(merge(root, children));
+        deleteNode(tree);
     }
 
     bool empty() const {
@@ -0,0 +1,155 @@
+#pragma once
+#ifndef LOSER_TREE_H_INCLUDED
+#define LOSER_TREE_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+
+// A pull source over an iterator range. Sources of a LoserTree have
+//
+//   typedef ... value_type;
+//   bool next(value_type &key); // the next key, false when there is none
+template <typename InputIt>
+class RangeSource {
+private:
+    InputIt first;
+    InputIt last;
+
+public:
+    typedef typename std::iterator_traits<InputIt>::value_type value_type;
+
+    RangeSource(InputIt first, InputIt last): first(first), last(last) {}
+
+    bool next(value_type &key) {
+        if (first == last)
+            return false;
+        key = *first;
+        ++first;
+        return true;
+    }
+};
+
+
+// Tournament tree of losers for merging k sorted sources: the inner nodes
+// keep the loser of the match played there, so when the winner moves to
+// its next key only its path to the root is replayed, one comparison per
+// level and no sift-down choosing between children. Nodes hold the key
+// with its source, all in one array of k, so the replay reads nothing but
+// the path; for the k of a merge the array stays in cache.
+//
+// Equal keys come out in the order of their sources, so a merge is stable
+// like a chain of std::merge. Keys must be default constructible.
+template <typename Source, typename Compare = std::less<typename Source::value_type>>
+class LoserTree {
+public:
+    typedef typename Source::value_type value_type;
+
+private:
+    // set in Entry::source once the source has run out: such an entry
+    // loses to every other one, and its key is not compared
+    static const size_t kDone = ~(~static_cast<size_t>(0) >> 1);
+
+    struct Entry {
+        value_type key;
+        size_t source;
+    };
+
+    std::vector<Source> sources;
+    std::vector<Entry> nodes; // nodes[0] is the winner, leaf i is node k + i
+    size_t k;
+    Compare less;
+
+    // the key of a goes first: one comparison, ties by source
+    bool beats(const Entry &a, const Entry &b) const {
+        if ((a.source | b.source) & kDone)
+            return a.source < b.source;
+        return (a.source < b.source ? !less(b.key, a.key) : less(a.key, b.key));
+    }
+
+    void pull(Entry &entry) {
+        if (!sources[entry.source].next(entry.key))
+            entry.source |= kDone;
+    }
+
+    void build() {
+        if (k == 0) return;
+        std::vector<Entry> winners(2 * k);
+        for (size_t i = 0; i < k; i++) {
+            winners[k + i].source = i;
+            pull(winners[k + i]);
+        }
+        for (size_t node = k; node-- > 1; ) {
+            Entry &a = winners[2 * node];
+            Entry &b = winners[2 * node + 1];
+            bool aWins = beats(a, b);
+            winners[node] = std::move(aWins ? a : b);
+            nodes[node] = std::move(aWins ? b : a);
+        }
+        nodes[0] = std::move(winners[1]);
+    }
+
+    // the winner has a new key (or ran out): replay from its leaf up
+    void replay() {
+        Entry winner = std::move(nodes[0]);
+        for (size_t node = (k + (winner.source & ~kDone)) / 2; node > 0; node /= 2)
+            if (beats(nodes[node], winner))
+                std::swap(nodes[node], winner);
+        nodes[0] = std::move(winner);
+    }
+
+public:
+    explicit LoserTree(std::vector<Source> sources, const Compare &less = Compare()):
+            sources(std::move(sources)), nodes(), k(0), less(less) {
+        k = this->sources.size();
+        nodes.resize(k > 0 ? k : 1);
+        build();
+    }
+
+    bool empty() const {
+        return (k == 0 || (nodes[0].source & kDone));
+    }
+
+    const value_type& getMin() const {
+        assert(!empty());
+        return nodes[0].key;
+    }
+
+    // Moves up to count keys in order to out; fewer only at the end.
+    size_t next(value_type *out, size_t count) {
+        size_t n = 0;
+        for (; n < count && !empty(); n++) {
+            out[n] = std::move(nodes[0].key);
+            pull(nodes[0]);
+            replay();
+        }
+        return n;
+    }
+};
+
+
+// Merges sorted ranges into out through a LoserTree, kBatch keys at a time.
+template <typename InputIt, typename OutputIt,
+          typename Compare = std::less<typename std::iterator_traits<InputIt>::value_type>>
+OutputIt mergeRanges(const std::vector<std::pair<InputIt, InputIt>> &ranges, OutputIt out,
+                     const Compare &less = Compare()) {
+    static const size_t kBatch = 256;
+    typedef RangeSource<InputIt> Source;
+
+    std::vector<Source> sources;
+    sources.reserve(ranges.size());
+    for (const std::pair<InputIt, InputIt> &range : ranges)
+        sources.push_back(Source(range.first, range.second));
+    LoserTree<Source, Compare> tree(std::move(sources), less);
+
+    std::vector<typename Source::value_type> batch(kBatch);
+    while (size_t count = tree.next(batch.data(), kBatch))
+        out = std::move(batch.begin(), batch.begin() + count, out);
+    return out;
+}
+
+#endif // #ifndef LOSER_TREE_H_INCLUDED
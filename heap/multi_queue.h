@@ -0,0 +1,132 @@
+#pragma once
+#ifndef MULTI_QUEUE_H_INCLUDED
+#define MULTI_QUEUE_H_INCLUDED
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <utility>
+
+#include "heap.h"
+
+
+// Relaxed concurrent priority queue (MultiQueue): keys are spread over
+// several heaps, each behind its own lock. insert goes to a random heap;
+// tryPop locks two random heaps and pops the smaller of their minima. So a
+// pop may miss the global minimum, but its expected rank stays within a
+// small multiple of the number of heaps. Use c * P heaps for P threads,
+// c = 2 or so: with more heaps locks collide less, with fewer the pops are
+// closer to exact.
+//
+// HeapT is any heap of heap.h (insert, getMin, pop, empty); each one is
+// only touched under its lock, so node pools need no locking either.
+template <typename HeapT>
+class MultiQueue {
+private:
+    typedef typename HeapT::value_type T;
+    typedef typename HeapT::value_compare Compare;
+
+    struct Shard {
+        std::mutex lock;
+        HeapT heap;
+        char padding[64]; // keeps the next lock off this cache line
+    };
+
+    // how many random shards insert and tryPop try before they block
+    static const int kAttempts = 16;
+
+    std::unique_ptr<Shard[]> shards;
+    size_t count;
+    std::atomic<size_t> keys; // in the shards; may lag behind while threads change them
+    Compare less;
+
+    static std::minstd_rand& random() {
+        static std::atomic<unsigned> seeds(1);
+        thread_local std::minstd_rand rng(seeds.fetch_add(1) * 7919u);
+        return rng;
+    }
+
+    size_t randomShard() {
+        return random()() % count;
+    }
+
+    // pops from a locked, non-empty shard
+    void popLocked(Shard &shard, T &key) {
+        key = shard.heap.pop();
+        keys.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Locks every shard in turn: false only if each was empty when visited.
+    bool sweep(T &key) {
+        for (size_t i = 0; i < count; i++) {
+            std::lock_guard<std::mutex> guard(shards[i].lock);
+            if (!shards[i].heap.empty()) {
+                popLocked(shards[i], key);
+                return true;
+            }
+        }
+        return false;
+    }
+
+public:
+    explicit MultiQueue(size_t shardCount, const Compare &less = Compare()):
+            shards(new Shard[shardCount]), count(shardCount), keys(0), less(less) {
+        assert(shardCount > 0);
+    }
+
+    MultiQueue(const MultiQueue&) = delete;
+    MultiQueue& operator=(const MultiQueue&) = delete;
+
+    void insert(T key) {
+        Shard *shard = &shards[randomShard()];
+        for (int attempt = 1; !shard->lock.try_lock(); attempt++) {
+            shard = &shards[randomShard()];
+            if (attempt == kAttempts) {
+                shard->lock.lock();
+                break;
+            }
+        }
+        shard->heap.insert(std::move(key));
+        // counted under the lock, so the pop of this key counts down after
+        keys.fetch_add(1, std::memory_order_relaxed);
+        shard->lock.unlock();
+    }
+
+    // Moves a key out, the smaller minimum of two random shards (one if the
+    // other is busy). Returns false if the queue was found empty.
+    bool tryPop(T &key) {
+        for (int attempt = 0; attempt < kAttempts; attempt++) {
+            if (keys.load(std::memory_order_relaxed) == 0)
+                break;
+            size_t i = randomShard();
+            size_t j = randomShard();
+            std::unique_lock<std::mutex> first(shards[i].lock, std::try_to_lock);
+            if (!first.owns_lock())
+                continue;
+            std::unique_lock<std::mutex> second;
+            if (j != i)
+                second = std::unique_lock<std::mutex>(shards[j].lock, std::try_to_lock);
+
+            Shard *best = &shards[i];
+            if (second.owns_lock() && !shards[j].heap.empty() &&
+                (best->heap.empty() || less(shards[j].heap.getMin(), best->heap.getMin())))
+                best = &shards[j];
+            if (best->heap.empty())
+                continue;
+            popLocked(*best, key);
+            return true;
+        }
+        return sweep(key);
+    }
+
+    size_t shardCount() const {return count;}
+
+    // exact only when no thread changes the queue
+    size_t size() const {return keys.load();}
+    bool empty() const {return size() == 0;}
+};
+
+#endif // #ifndef MULTI_QUEUE_H_INCLUDED
@@ -0,0 +1,278 @@
+#pragma once
+#ifndef NODE_POOL_H_INCLUDED
+#define NODE_POOL_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+
+// Arena for heap nodes: small blocks carved out of slabs, one free list per
+// size class, so inserting into a heap that has been popped before does not
+// allocate at all. Not thread-safe: a pool belongs to the heaps of one thread.
+//
+// Heaps hold their pool by shared_ptr, and several heaps may share one.
+// Melding heaps with different pools merges the pools: the slabs and free
+// lists of one move to the other, which it forwards to from then on (a
+// union-find over pools), so nodes of both heaps can be freed into either.
+// Pools must be created by std::make_shared. Blocks too large for the size
+// classes come from operator new one by one, chained into the pool so that
+// release() still frees them.
+//
+// Heaps on one pool meld without merging pools and recycle each other's
+// nodes. A heap attaches to its pool for its lifetime; the last one to
+// detach, if its keys need no destructor, does not walk its nodes but
+// release()s the pool, in O(slabs).
+class NodePool : public std::enable_shared_from_this<NodePool> {
+private:
+    static const size_t kAlign = alignof(std::max_align_t);
+    static const size_t kClasses = 16; // blocks up to kClasses * kAlign bytes
+    static const size_t kFirstSlabBlocks = 64;
+    static const size_t kMaxSlabBlocks = 64 * 1024;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    // header of a block above the size classes; circular, around `large`
+    struct LargeBlock {
+        LargeBlock *prev;
+        LargeBlock *next;
+        size_t bytes;
+    };
+    static const size_t kLargeHeader = (sizeof(LargeBlock) + kAlign - 1) / kAlign * kAlign;
+
+    struct SizeClass {
+        FreeBlock *freeHead;
+        FreeBlock *freeTail;
+        char *fresh;       // never used blocks of the last slab
+        size_t freshLeft;
+        size_t slabBlocks; // of the next slab
+    };
+
+    SizeClass classes[kClasses];
+    LargeBlock large;
+    std::vector<void*> slabs;
+    size_t slabBytes;
+    size_t users;                   // heaps attached to this pool, if it is a root
+    std::shared_ptr<NodePool> into; // set once merged into another pool
+    // pools merged into this root, kept alive for the NodePoolAllocators
+    // that point to them until the last heap detaches
+    std::vector<std::shared_ptr<NodePool>> absorbed;
+
+    static size_t sizeClass(size_t bytes) {
+        return (bytes + kAlign - 1) / kAlign - 1;
+    }
+
+    void* newLarge(size_t bytes) {
+        LargeBlock *block = static_cast<LargeBlock*>(::operator new(kLargeHeader + bytes));
+        block->bytes = kLargeHeader + bytes;
+        block->prev = &large;
+        block->next = large.next;
+        large.next->prev = block;
+        large.next = block;
+        slabBytes += block->bytes;
+        return reinterpret_cast<char*>(block) + kLargeHeader;
+    }
+
+    void deleteLarge(void *ptr) {
+        LargeBlock *block = reinterpret_cast<LargeBlock*>(static_cast<char*>(ptr) - kLargeHeader);
+        block->prev->next = block->next;
+        block->next->prev = block->prev;
+        slabBytes -= block->bytes;
+        ::operator delete(block);
+    }
+
+    void deleteAllLarge() {
+        while (large.next != &large)
+            deleteLarge(reinterpret_cast<char*>(large.next) + kLargeHeader);
+    }
+
+    NodePool* root() {
+        if (into == nullptr)
+            return this;
+        NodePool *top = into->root();
+        if (into.get() != top)
+            into = top->shared_from_this();
+        return top;
+    }
+
+    void* newBlock(size_t cls) {
+        SizeClass &sc = classes[cls];
+        if (sc.freshLeft == 0) {
+            size_t bytes = sc.slabBlocks * (cls + 1) * kAlign;
+            sc.fresh = static_cast<char*>(::operator new(bytes));
+            sc.freshLeft = sc.slabBlocks;
+            slabs.push_back(sc.fresh);
+            slabBytes += bytes;
+            sc.slabBlocks = (2 * sc.slabBlocks < kMaxSlabBlocks ? 2 * sc.slabBlocks : kMaxSlabBlocks);
+        }
+        void *block = sc.fresh;
+        sc.fresh += (cls + 1) * kAlign;
+        sc.freshLeft--;
+        return block;
+    }
+
+    void clearClasses() {
+        for (SizeClass &sc : classes)
+            sc = SizeClass{nullptr, nullptr, nullptr, 0, kFirstSlabBlocks};
+    }
+
+public:
+    NodePool(): large(), slabs(), slabBytes(0), users(0), into(), absorbed() {
+        large.prev = large.next = &large;
+        clearClasses();
+    }
+
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    ~NodePool() {
+        deleteAllLarge();
+        for (void *slab : slabs)
+            ::operator delete(slab);
+    }
+
+    void* allocate(size_t bytes) {
+        NodePool *pool = root();
+        if (sizeClass(bytes) >= kClasses)
+            return pool->newLarge(bytes);
+        SizeClass &sc = pool->classes[sizeClass(bytes)];
+        if (sc.freeHead == nullptr)
+            return pool->newBlock(sizeClass(bytes));
+        FreeBlock *block = sc.freeHead;
+        sc.freeHead = block->next;
+        if (sc.freeHead == nullptr)
+            sc.freeTail = nullptr;
+        return block;
+    }
+
+    void deallocate(void *ptr, size_t bytes) {
+        if (sizeClass(bytes) >= kClasses) {
+            root()->deleteLarge(ptr);
+            return;
+        }
+        SizeClass &sc = root()->classes[sizeClass(bytes)];
+        FreeBlock *block = static_cast<FreeBlock*>(ptr);
+        block->next = sc.freeHead;
+        sc.freeHead = block;
+        if (sc.freeTail == nullptr)
+            sc.freeTail = block;
+    }
+
+    // Heaps attach to their pool for their lifetime. detach returns whether
+    // that was the last heap of the (merged) pool: then the heap may leave
+    // its nodes as they are and release() the whole pool instead.
+    void attach() {root()->users++;}
+    bool detach() {
+        NodePool *pool = root();
+        assert(pool->users > 0);
+        if (--pool->users > 0)
+            return false;
+        pool->absorbed.clear();
+        return true;
+    }
+
+    // whether detach would return true
+    bool lastUser() {return root()->users == 1;}
+
+    // Forgets every block at once. Only when no heap uses the pool.
+    void release() {
+        NodePool *pool = root();
+        assert(pool->users == 0);
+        pool->deleteAllLarge();
+        for (void *slab : pool->slabs)
+            ::operator delete(slab);
+        pool->slabs.clear();
+        pool->slabBytes = 0;
+        pool->clearClasses();
+    }
+
+    bool sameAs(NodePool &other) {return root() == other.root();}
+
+    // bytes taken from operator new
+    size_t footprint() {return root()->slabBytes;}
+
+    // O(size classes + slabs of the smaller pool)
+    static void merge(NodePool &a, NodePool &b) {
+        NodePool *to = a.root();
+        NodePool *from = b.root();
+        if (to == from) return;
+        if (to->slabs.size() < from->slabs.size())
+            std::swap(to, from);
+
+        for (size_t cls = 0; cls < kClasses; cls++) {
+            SizeClass &src = from->classes[cls];
+            SizeClass &dst = to->classes[cls];
+            if (src.freeHead != nullptr) {
+                src.freeTail->next = dst.freeHead;
+                dst.freeHead = src.freeHead;
+                if (dst.freeTail == nullptr)
+                    dst.freeTail = src.freeTail;
+            }
+            // the unused rest of the last slab is given up
+        }
+        if (from->large.next != &from->large) {
+            from->large.prev->next = to->large.next;
+            to->large.next->prev = from->large.prev;
+            to->large.next = from->large.next;
+            from->large.next->prev = &to->large;
+            from->large.prev = from->large.next = &from->large;
+        }
+        to->slabs.insert(to->slabs.end(), from->slabs.begin(), from->slabs.end());
+        to->slabBytes += from->slabBytes;
+        to->users += from->users;
+        to->absorbed.push_back(from->shared_from_this());
+        to->absorbed.insert(to->absorbed.end(), from->absorbed.begin(), from->absorbed.end());
+
+        from->slabs.clear();
+        from->absorbed.clear();
+        from->slabBytes = 0;
+        from->users = 0;
+        from->clearClasses();
+        from->into = to->shared_from_this();
+    }
+};
+
+
+// std::allocator interface over a NodePool, for node-based std containers.
+// Copies share the pool; allocators compare equal once their pools are merged.
+// The pool is held by a plain pointer, so containers left in a released pool
+// hold no references to it: a heap keeps its pool alive, and a merged root
+// keeps the pools merged into it while any heap is attached.
+template <typename T>
+class NodePoolAllocator {
+private:
+    template <typename U> friend class NodePoolAllocator;
+
+    NodePool *pool;
+
+public:
+    typedef T value_type;
+
+    explicit NodePoolAllocator(const std::shared_ptr<NodePool> &pool): pool(pool.get()) {}
+
+    template <typename U>
+    NodePoolAllocator(const NodePoolAllocator<U> &other): pool(other.pool) {}
+
+    T* allocate(size_t n) {
+        assert(n == 1);
+        return static_cast<T*>(pool->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T *ptr, size_t n) {
+        pool->deallocate(ptr, n * sizeof(T));
+    }
+
+    std::shared_ptr<NodePool> getPool() const {return pool->shared_from_this();}
+
+    template <typename U>
+    bool operator==(const NodePoolAllocator<U> &other) const {return pool->sameAs(*other.pool);}
+    template <typename U>
+    bool operator!=(const NodePoolAllocator<U> &other) const {return !(*this == other);}
+};
+
+#endif // #ifndef NODE_POOL_H_INCLUDED
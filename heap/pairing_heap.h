@@ -0,0 +1,182 @@
+#pragma once
+#ifndef PAIRING_HEAP_H_INCLUDED
+#define PAIRING_HEAP_H_INCLUDED
+
+#include <cassert>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+
+// Pairing heap: a heap-ordered tree with any number of children, kept as
+// child / next-sibling lists. insert, meld and decreaseKey link two trees
+// in O(1); extractMin pairs up the children of the root left to right and
+// links the pairs right to left, amortized O(log n).
+template <typename T, typename Compare = std::less<T>>
+class PairingHeap {
+private:
+    struct PairingTree {
+        T key;
+        PairingTree *child;
+        PairingTree *next;
+        PairingTree *prev; // previous sibling, or the parent for a first child
+
+        template <typename... Args>
+        explicit PairingTree(Args&&... args): key(std::forward<Args>(args)...),
+                                              child(nullptr), next(nullptr), prev(nullptr) {}
+    };
+
+    // no recursion: a root may have any number of children
+    static void deleteTree(PairingTree *tree) {
+        std::vector<PairingTree*> stack;
+        if (tree != nullptr)
+            stack.push_back(tree);
+        while (!stack.empty()) {
+            tree = stack.back();
+            stack.pop_back();
+            if (tree->child != nullptr) stack.push_back(tree->child);
+            if (tree->next != nullptr) stack.push_back(tree->next);
+            delete tree;
+        }
+    }
+
+    // both are roots; the greater one becomes the first child of the other
+    PairingTree* link(PairingTree *a, PairingTree *b) {
+        if (a == nullptr) return b;
+        if (b == nullptr) return a;
+        if (less(b->key, a->key))
+            std::swap(a, b);
+        b->prev = a;
+        b->next = a->child;
+        if (a->child != nullptr)
+            a->child->prev = b;
+        a->child = b;
+        return a;
+    }
+
+    // two-pass pairing of a sibling list
+    PairingTree* combine(PairingTree *first) {
+        std::vector<PairingTree*> pairs;
+        while (first != nullptr) {
+            PairingTree *a = first;
+            PairingTree *b = a->next;
+            first = (b != nullptr ? b->next : nullptr);
+            a->next = a->prev = nullptr;
+            if (b != nullptr)
+                b->next = b->prev = nullptr;
+            pairs.push_back(link(a, b));
+        }
+        PairingTree *result = nullptr;
+        while (!pairs.empty()) {
+            result = link(pairs.back(), result);
+            pairs.pop_back();
+        }
+        return result;
+    }
+
+    // unlinks the subtree of a non-root tree from its siblings
+    static void cut(PairingTree *tree) {
+        if (tree->prev->child == tree)
+            tree->prev->child = tree->next;
+        else
+            tree->prev->next = tree->next;
+        if (tree->next != nullptr)
+            tree->next->prev = tree->prev;
+        tree->next = tree->prev = nullptr;
+    }
+
+    PairingTree *root;
+    Compare less;
+
+public:
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    PairingHeap(PairingHeap &&other): root(other.root), less(other.less) {
+        other.root = nullptr;
+    }
+
+    PairingHeap(const PairingHeap&) = delete;
+    PairingHeap& operator=(const PairingHeap &other) = delete;
+
+    explicit PairingHeap(const Compare &less = Compare()): root(nullptr), less(less) {}
+
+    // O(n) like the inserts: the first extractMin pairs up the keys
+    template <typename InputIt>
+    PairingHeap(InputIt first, InputIt last, const Compare &less = Compare()): root(nullptr), less(less) {
+        for (; first != last; ++first)
+            root = link(root, new PairingTree(*first));
+    }
+
+    ~PairingHeap() {
+        deleteTree(root);
+        root = nullptr;
+    }
+
+    const T& getMin() const {
+        assert(root != nullptr);
+        return root->key;
+    }
+
+    void meld(PairingHeap &&other) {
+        if (this == &other) return;
+        root = link(root, other.root);
+        other.root = nullptr;
+    }
+
+    HeapHandle insert(T key) {
+        return emplace(std::move(key));
+    }
+
+    // the key is constructed in its node
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        PairingTree *tree = new PairingTree(std::forward<Args>(args)...);
+        root = link(root, tree);
+        return HeapHandle(tree);
+    }
+
+    // extractMin that moves the key out
+    T pop() {
+        assert(root != nullptr);
+        T key = std::move(root->key);
+        extractMin();
+        return key;
+    }
+
+    void extractMin() {
+        assert(root != nullptr);
+        PairingTree *oldRoot = root;
+        root = combine(root->child);
+        delete oldRoot;
+    }
+
+    void decreaseKey(HeapHandle handle, T newKey) {
+        PairingTree *tree = handle.as<PairingTree>();
+        assert(!less(tree->key, newKey));
+        tree->key = std::move(newKey);
+        if (tree == root)
+            return;
+        cut(tree);
+        root = link(root, tree);
+    }
+
+    void erase(HeapHandle handle) {
+        PairingTree *tree = handle.as<PairingTree>();
+        if (tree == root) {
+            extractMin();
+            return;
+        }
+        cut(tree);
+        root = link(root, combine(tree->child));
+        delete tree;
+    }
+
+    bool empty() const {
+        return (root == nullptr);
+    }
+};
+
+#endif // #ifndef PAIRING_HEAP_H_INCLUDED
@@ -0,0 +1,173 @@
+#pragma once
+#ifndef PERSISTENT_LEFTIST_HEAP_H_INCLUDED
+#define PERSISTENT_LEFTIST_HEAP_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "node_pool.h"
+
+
+// Persistent leftist heap: a value that never changes. insert, extractMin
+// and meld return a new heap in O(log n) and leave this one as it was; the
+// new heap copies only the nodes of the merged right spine and shares all
+// others. Copying a heap is O(1), so snapshots are free.
+//
+// Nodes are reference counted and come from a NodePool shared by all heaps
+// derived from one another. Like the pool, not thread-safe: heaps sharing
+// nodes belong to one thread.
+template <typename T, typename Compare = std::less<T>>
+class PersistentLeftistHeap {
+private:
+    struct LeftistTree {
+        T key;
+        LeftistTree *left;
+        LeftistTree *right;
+        size_t dist;
+        size_t refs; // heaps and parents pointing here
+
+        LeftistTree(const T &key, LeftistTree *left, LeftistTree *right):
+                key(key), left(left), right(right), dist(1), refs(1) {}
+    };
+
+    // a right spine has at most log2(n + 1) nodes, a merge walks two
+    static const size_t kMaxPath = 2 * 8 * sizeof(size_t);
+
+    static size_t dist(const LeftistTree *tree) {
+        return (tree == nullptr ? 0 : tree->dist);
+    }
+
+    static LeftistTree* acquire(LeftistTree *tree) {
+        if (tree != nullptr)
+            tree->refs++;
+        return tree;
+    }
+
+    // takes a reference to each child
+    LeftistTree* newTree(const T &key, LeftistTree *left, LeftistTree *right) const {
+        return new (pool->allocate(sizeof(LeftistTree))) LeftistTree(key, acquire(left), acquire(right));
+    }
+
+    // Drops a reference; no recursion when that frees a whole subtree.
+    void release(LeftistTree *tree) const {
+        if (tree == nullptr || --tree->refs > 0)
+            return;
+        std::vector<LeftistTree*> unused(1, tree);
+        while (!unused.empty()) {
+            tree = unused.back();
+            unused.pop_back();
+            if (tree->left != nullptr && --tree->left->refs == 0)
+                unused.push_back(tree->left);
+            if (tree->right != nullptr && --tree->right->refs == 0)
+                unused.push_back(tree->right);
+            tree->~LeftistTree();
+            pool->deallocate(tree, sizeof(LeftistTree));
+        }
+    }
+
+    // Top-down along the right spines like LeftistHeap, but every node on
+    // the way is a copy; the copies are then fixed up bottom-up. Returns a
+    // new reference.
+    LeftistTree* merge(LeftistTree *left, LeftistTree *right) const {
+        LeftistTree *path[kMaxPath];
+        size_t length = 0;
+        LeftistTree *result = nullptr;
+        LeftistTree **link = &result;
+        while (left != nullptr && right != nullptr) {
+            if (less(right->key, left->key))
+                std::swap(left, right);
+            LeftistTree *copy = newTree(left->key, left->left, nullptr);
+            path[length++] = copy;
+            *link = copy;
+            link = &copy->right;
+            left = left->right;
+        }
+        *link = acquire(left != nullptr ? left : right);
+
+        while (length > 0) {
+            LeftistTree *tree = path[--length];
+            if (dist(tree->left) < dist(tree->right))
+                std::swap(tree->left, tree->right);
+            tree->dist = dist(tree->right) + 1;
+        }
+        return result;
+    }
+
+    PersistentLeftistHeap(std::shared_ptr<NodePool> pool, LeftistTree *root, size_t count, const Compare &less):
+            pool(std::move(pool)), root(root), count(count), less(less) {}
+
+    std::shared_ptr<NodePool> pool;
+    LeftistTree *root;
+    size_t count;
+    Compare less;
+
+public:
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    explicit PersistentLeftistHeap(const Compare &less = Compare()):
+            PersistentLeftistHeap(std::make_shared<NodePool>(), less) {}
+
+    explicit PersistentLeftistHeap(std::shared_ptr<NodePool> pool, const Compare &less = Compare()):
+            pool(std::move(pool)), root(nullptr), count(0), less(less) {}
+
+    // O(1)
+    PersistentLeftistHeap(const PersistentLeftistHeap &other):
+            pool(other.pool), root(acquire(other.root)), count(other.count), less(other.less) {}
+
+    PersistentLeftistHeap(PersistentLeftistHeap &&other):
+            pool(other.pool), root(other.root), count(other.count), less(other.less) {
+        other.root = nullptr;
+        other.count = 0;
+    }
+
+    PersistentLeftistHeap& operator=(PersistentLeftistHeap other) {
+        std::swap(pool, other.pool);
+        std::swap(root, other.root);
+        std::swap(count, other.count);
+        std::swap(less, other.less);
+        return *this;
+    }
+
+    ~PersistentLeftistHeap() {
+        release(root);
+    }
+
+    const T& getMin() const {
+        assert(root != nullptr);
+        return root->key;
+    }
+
+    PersistentLeftistHeap insert(const T &key) const {
+        LeftistTree *single = newTree(key, nullptr, nullptr);
+        LeftistTree *merged = merge(root, single);
+        release(single);
+        return PersistentLeftistHeap(pool, merged, count + 1, less);
+    }
+
+    PersistentLeftistHeap extractMin() const {
+        assert(root != nullptr);
+        return PersistentLeftistHeap(pool, merge(root->left, root->right), count - 1, less);
+    }
+
+    // Heaps on different pools merge their pools, like LeftistHeap::meld.
+    PersistentLeftistHeap meld(const PersistentLeftistHeap &other) const {
+        NodePool::merge(*pool, *other.pool);
+        return PersistentLeftistHeap(pool, merge(root, other.root), count + other.count, less);
+    }
+
+    bool empty() const {
+        return (root == nullptr);
+    }
+
+    size_t size() const {
+        return count;
+    }
+};
+
+#endif // #ifndef PERSISTENT_LEFTIST_HEAP_H_INCLUDED
@@ -0,0 +1,160 @@
+#pragma once
+#ifndef PERSISTENT_SKEW_HEAP_H_INCLUDED
+#define PERSISTENT_SKEW_HEAP_H_INCLUDED
+
+#include <cassert>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "node_pool.h"
+
+
+// Persistent skew heap: a value that never changes. insert, extractMin and
+// meld return a new heap and leave this one as it was; the new heap copies
+// only the nodes of the merged right spines and shares all others. Copying
+// a heap is O(1), so snapshots are free.
+//
+// The O(log n) of skew heaps is amortized, and that does not survive
+// persistence: the same expensive old heap can be extracted from again and
+// again. Where old heaps are used more than once, PersistentLeftistHeap
+// gives O(log n) worst case.
+//
+// Nodes are reference counted and come from a NodePool shared by all heaps
+// derived from one another. Like the pool, not thread-safe: heaps sharing
+// nodes belong to one thread.
+template <typename T, typename Compare = std::less<T>>
+class PersistentSkewHeap {
+private:
+    struct SkewTree {
+        T key;
+        SkewTree *left;
+        SkewTree *right;
+        size_t refs; // heaps and parents pointing here
+
+        SkewTree(const T &key, SkewTree *left, SkewTree *right):
+                key(key), left(left), right(right), refs(1) {}
+    };
+
+    static SkewTree* acquire(SkewTree *tree) {
+        if (tree != nullptr)
+            tree->refs++;
+        return tree;
+    }
+
+    // takes a reference to each child
+    SkewTree* newTree(const T &key, SkewTree *left, SkewTree *right) const {
+        return new (pool->allocate(sizeof(SkewTree))) SkewTree(key, acquire(left), acquire(right));
+    }
+
+    // Drops a reference; no recursion when that frees a whole subtree.
+    void release(SkewTree *tree) const {
+        if (tree == nullptr || --tree->refs > 0)
+            return;
+        std::vector<SkewTree*> unused(1, tree);
+        while (!unused.empty()) {
+            tree = unused.back();
+            unused.pop_back();
+            if (tree->left != nullptr && --tree->left->refs == 0)
+                unused.push_back(tree->left);
+            if (tree->right != nullptr && --tree->right->refs == 0)
+                unused.push_back(tree->right);
+            tree->~SkewTree();
+            pool->deallocate(tree, sizeof(SkewTree));
+        }
+    }
+
+    // Top-down along the right spines like SkewHeap, but every node on the
+    // way is a copy, with the rest of the merge as its left child and its
+    // old left child as the right one. Returns a new reference.
+    SkewTree* merge(SkewTree *left, SkewTree *right) const {
+        SkewTree *result = nullptr;
+        SkewTree **link = &result;
+        while (left != nullptr && right != nullptr) {
+            if (less(right->key, left->key))
+                std::swap(left, right);
+            SkewTree *copy = newTree(left->key, nullptr, left->left);
+            *link = copy;
+            link = &copy->left;
+            left = left->right;
+        }
+        *link = acquire(left != nullptr ? left : right);
+        return result;
+    }
+
+    PersistentSkewHeap(std::shared_ptr<NodePool> pool, SkewTree *root, size_t count, const Compare &less):
+            pool(std::move(pool)), root(root), count(count), less(less) {}
+
+    std::shared_ptr<NodePool> pool;
+    SkewTree *root;
+    size_t count;
+    Compare less;
+
+public:
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    explicit PersistentSkewHeap(const Compare &less = Compare()):
+            PersistentSkewHeap(std::make_shared<NodePool>(), less) {}
+
+    explicit PersistentSkewHeap(std::shared_ptr<NodePool> pool, const Compare &less = Compare()):
+            pool(std::move(pool)), root(nullptr), count(0), less(less) {}
+
+    // O(1)
+    PersistentSkewHeap(const PersistentSkewHeap &other):
+            pool(other.pool), root(acquire(other.root)), count(other.count), less(other.less) {}
+
+    PersistentSkewHeap(PersistentSkewHeap &&other):
+            pool(other.pool), root(other.root), count(other.count), less(other.less) {
+        other.root = nullptr;
+        other.count = 0;
+    }
+
+    PersistentSkewHeap& operator=(PersistentSkewHeap other) {
+        std::swap(pool, other.pool);
+        std::swap(root, other.root);
+        std::swap(count, other.count);
+        std::swap(less, other.less);
+        return *this;
+    }
+
+    ~PersistentSkewHeap() {
+        release(root);
+    }
+
+    const T& getMin() const {
+        assert(root != nullptr);
+        return root->key;
+    }
+
+    PersistentSkewHeap insert(const T &key) const {
+        SkewTree *single = newTree(key, nullptr, nullptr);
+        SkewTree *merged = merge(root, single);
+        release(single);
+        return PersistentSkewHeap(pool, merged, count + 1, less);
+    }
+
+    PersistentSkewHeap extractMin() const {
+        assert(root != nullptr);
+        return PersistentSkewHeap(pool, merge(root->left, root->right), count - 1, less);
+    }
+
+    // Heaps on different pools merge their pools, like LeftistHeap::meld.
+    PersistentSkewHeap meld(const PersistentSkewHeap &other) const {
+        NodePool::merge(*pool, *other.pool);
+        return PersistentSkewHeap(pool, merge(root, other.root), count + other.count, less);
+    }
+
+    bool empty() const {
+        return (root == nullptr);
+    }
+
+    size_t size() const {
+        return count;
+    }
+};
+
+#endif // #ifndef PERSISTENT_SKEW_HEAP_H_INCLUDED
@@ -0,0 +1,180 @@
+#pragma once
+#ifndef RADIX_HEAP_H_INCLUDED
+#define RADIX_HEAP_H_INCLUDED
+
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "heap.h"
+
+
+// What a RadixHeap stores: the key alone, or a (key, value) pair.
+template <typename Key, typename Value>
+struct RadixHeapItem {
+    typedef std::pair<Key, Value> type;
+    static Key key(const type &item) {return item.first;}
+};
+
+template <typename Key>
+struct RadixHeapItem<Key, void> {
+    typedef Key type;
+    static Key key(Key item) {return item;}
+};
+
+
+// Radix heap: a monotone priority queue of unsigned integer keys, as in
+// event simulation or Dijkstra's algorithm, where no key inserted is less
+// than a minimum already seen. Keys sit in buckets by the highest bit in
+// which they differ from `last`, the latest minimum; when bucket 0 (keys
+// equal to last) runs out, the first non-empty bucket is spread over the
+// lower ones around its minimum. A key only moves down, so operations are
+// amortized O(log C) for keys up to C, with no comparisons between keys
+// and all buckets in contiguous vectors.
+//
+// The precondition: insert takes no key less than the last one returned by
+// getMin or taken out by extractMin / pop (checked by assert). meld is
+// O(size of one heap), whose keys are redistributed; after it the lesser
+// of the two minima seen is the bound. Handles are null.
+template <typename Key, typename Value = void>
+class RadixHeap {
+private:
+    static_assert(std::is_unsigned<Key>::value, "RadixHeap needs unsigned integer keys");
+
+    typedef RadixHeapItem<Key, Value> Item;
+
+public:
+    typedef typename Item::type value_type;
+
+    struct value_compare {
+        bool operator()(const value_type &a, const value_type &b) const {
+            return Item::key(a) < Item::key(b);
+        }
+    };
+
+private:
+    // bucket 0 for key == last, bucket b + 1 for highest differing bit b
+    static const size_t kBuckets = CHAR_BIT * sizeof(Key) + 1;
+
+    static size_t highestBit(Key bits) {
+#ifdef __GNUC__
+        return CHAR_BIT * sizeof(unsigned long long) - 1 - __builtin_clzll(bits);
+#else
+        size_t bit = 0;
+        while (bits >>= 1)
+            bit++;
+        return bit;
+#endif
+    }
+
+    size_t bucketOf(Key key) const {
+        assert(key >= last);
+        return (key == last ? 0 : highestBit(key ^ last) + 1);
+    }
+
+    // Refills bucket 0 from the first non-empty bucket, whose minimum
+    // becomes last; getMin does it too, hence the mutable buckets.
+    void pull() const {
+        assert(count > 0);
+        if (!buckets[0].empty())
+            return;
+        size_t index = 1;
+        while (buckets[index].empty())
+            index++;
+        std::vector<value_type> &bucket = buckets[index];
+        Key min = Item::key(bucket[0]);
+        for (const value_type &item : bucket)
+            if (Item::key(item) < min)
+                min = Item::key(item);
+        last = min;
+        // each item lands in a bucket below index
+        for (value_type &item : bucket)
+            buckets[bucketOf(Item::key(item))].push_back(std::move(item));
+        bucket.clear();
+    }
+
+    mutable std::vector<value_type> buckets[kBuckets];
+    mutable Key last;
+    size_t count;
+
+public:
+    explicit RadixHeap(const value_compare& = value_compare()): last(0), count(0) {}
+
+    RadixHeap(RadixHeap &&other): last(other.last), count(other.count) {
+        for (size_t i = 0; i < kBuckets; i++)
+            buckets[i].swap(other.buckets[i]);
+        other.count = 0;
+    }
+
+    RadixHeap(const RadixHeap&) = delete;
+    RadixHeap& operator=(const RadixHeap&) = delete;
+
+    template <typename InputIt>
+    RadixHeap(InputIt first, InputIt last, const value_compare &less = value_compare()): RadixHeap(less) {
+        for (; first != last; ++first)
+            insert(*first);
+    }
+
+    const value_type& getMin() const {
+        pull();
+        return buckets[0].back();
+    }
+
+    // O(size of the heap with the greater bound): its keys go to the
+    // buckets of the other one
+    void meld(RadixHeap &&other) {
+        if (this == &other || other.count == 0) return;
+        if (other.last < last) {
+            std::swap(last, other.last);
+            std::swap(count, other.count);
+            for (size_t i = 0; i < kBuckets; i++)
+                buckets[i].swap(other.buckets[i]);
+        }
+        for (std::vector<value_type> &bucket : other.buckets) {
+            for (value_type &item : bucket)
+                buckets[bucketOf(Item::key(item))].push_back(std::move(item));
+            bucket.clear();
+        }
+        count += other.count;
+        other.count = 0;
+    }
+
+    HeapHandle insert(value_type item) {
+        return emplace(std::move(item));
+    }
+
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        value_type item(std::forward<Args>(args)...);
+        buckets[bucketOf(Item::key(item))].push_back(std::move(item));
+        count++;
+        return HeapHandle();
+    }
+
+    void extractMin() {
+        pull();
+        buckets[0].pop_back();
+        count--;
+    }
+
+    value_type pop() {
+        pull();
+        value_type item = std::move(buckets[0].back());
+        buckets[0].pop_back();
+        count--;
+        return item;
+    }
+
+    bool empty() const {
+        return (count == 0);
+    }
+
+    size_t size() const {
+        return count;
+    }
+};
+
+#endif // #ifndef RADIX_HEAP_H_INCLUDED
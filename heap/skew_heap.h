@@ -1,79 +1,205 @@
+#include <functional>
+#include <memory>
+#include <new>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "heap.h"
+#include "node_pool.h"
 
-template <typename T>
-class SkewHeap : public IHeap<T> {
+template <typename T, typename Compare = std::less<T>>
+class SkewHeap {
 private:
     struct SkewTree {
         T key;
         SkewTree *left;
         SkewTree *right;
+        SkewTree *parent;
 
-        SkewTree(T key): key(key), left(nullptr), right(nullptr) {}
+        template <typename... Args>
+        explicit SkewTree(Args&&... args): key(std::forward<Args>(args)...),
+                                           left(nullptr), right(nullptr), parent(nullptr) {}
     };
 
-    static void deleteTree(SkewTree *tree) {
-        if (tree == nullptr) return;
-        deleteTree(tree->left);
-        deleteTree(tree->right);
-        delete tree;
+    template <typename... Args>
+    SkewTree* newTree(Args&&... args) {
+        return new (pool->allocate(sizeof(SkewTree))) SkewTree(std::forward<Args>(args)...);
     }
 
-    static SkewTree* merge(SkewTree *left, SkewTree *right) {
-        if (left == nullptr) return right;
-        if (right == nullptr) return left;
-        assert(left != right);
+    void deleteNode(SkewTree *tree) {
+        tree->~SkewTree();
+        pool->deallocate(tree, sizeof(SkewTree));
+    }
+
+    // No recursion, no stack: a left child is rotated up until there is
+    // none, then the node goes. Sorted inserts leave chains of n nodes.
+    void deleteTree(SkewTree *tree) {
+        while (tree != nullptr) {
+            SkewTree *left = tree->left;
+            if (left != nullptr) {
+                tree->left = left->right;
+                left->right = tree;
+                tree = left;
+            } else {
+                SkewTree *right = tree->right;
+                deleteNode(tree);
+                tree = right;
+            }
+        }
+    }
 
-        if (left->key > right->key)
-            std::swap(left, right);
+    // Top-down along the right spines, which in a skew heap may be long:
+    // each node taken gets the rest of the merge as its left child and its
+    // old left child as the right one. The result has no parent.
+    SkewTree* merge(SkewTree *left, SkewTree *right) {
+        SkewTree *result = nullptr;
+        SkewTree **link = &result;
+        SkewTree *parent = nullptr;
+        while (left != nullptr && right != nullptr) {
+            assert(left != right);
+            if (less(right->key, left->key))
+                std::swap(left, right);
+            *link = left;
+            left->parent = parent;
+            parent = left;
+            SkewTree *rest = left->right;
+            left->right = left->left;
+            link = &left->left;
+            left = rest;
+        }
+        *link = (left != nullptr ? left : right);
+        if (*link != nullptr)
+            (*link)->parent = parent;
+        return result;
+    }
 
-        left->right = merge(left->right, right);
-        std::swap(left->left, left->right);
-        return left;
+    // O(n): singletons are merged pairwise, round by round
+    SkewTree* mergeAll(std::vector<SkewTree*> &trees) {
+        if (trees.empty()) return nullptr;
+        for (size_t count = trees.size(); count > 1; count = (count + 1) / 2)
+            for (size_t i = 0; i < count; i += 2)
+                trees[i / 2] = (i + 1 < count ? merge(trees[i], trees[i + 1]) : trees[i]);
+        return trees[0];
     }
 
+    // unlinks the subtree of tree from the heap
+    void detach(SkewTree *tree) {
+        SkewTree *parent = tree->parent;
+        if (parent == nullptr) {
+            root = nullptr;
+            return;
+        }
+        (parent->left == tree ? parent->left : parent->right) = nullptr;
+        tree->parent = nullptr;
+    }
+
+    void setRoot(SkewTree *tree) {
+        root = tree;
+        if (root != nullptr)
+            root->parent = nullptr;
+    }
+
+    std::shared_ptr<NodePool> pool;
     SkewTree *root;
-    
+    Compare less;
+
 public:
-    SkewHeap(SkewHeap &&other): root(other.root) {
+    typedef T value_type;
+    typedef Compare value_compare;
+
+    SkewHeap(SkewHeap &&other): pool(other.pool), root(other.root), less(other.less) {
+        pool->attach();
         other.root = nullptr;
     }
 
     SkewHeap(const SkewHeap&) = delete;
     SkewHeap& operator=(const SkewHeap &other) = delete;
 
-    SkewHeap(): root(nullptr) {}
+    explicit SkewHeap(const Compare &less = Compare()): SkewHeap(std::make_shared<NodePool>(), less) {}
 
-    virtual ~SkewHeap() {
-        deleteTree(root);
+    explicit SkewHeap(std::shared_ptr<NodePool> pool, const Compare &less = Compare()):
+            pool(std::move(pool)), root(nullptr), less(less) {
+        this->pool->attach();
+    }
+
+    template <typename InputIt>
+    SkewHeap(InputIt first, InputIt last, std::shared_ptr<NodePool> pool = std::make_shared<NodePool>(),
+            const Compare &less = Compare()): SkewHeap(std::move(pool), less) {
+        std::vector<SkewTree*> trees;
+        for (; first != last; ++first)
+            trees.push_back(newTree(*first));
+        setRoot(mergeAll(trees));
+    }
+
+    ~SkewHeap() {
+        if (pool->detach() && std::is_trivially_destructible<T>::value)
+            pool->release();
+        else
+            deleteTree(root);
         root = nullptr;
     }
 
-    virtual T getMin() const override {
+    const T& getMin() const {
         assert(root != nullptr);
         return root->key;
     }
 
-    virtual void meld(IHeap<T> &&other) override {
-        meld(std::move(dynamic_cast<SkewHeap&>(other)));
-    }
-
     void meld(SkewHeap &&other) {
         if (this == &other) return;
-        root = merge(root, other.root);
+        NodePool::merge(*pool, *other.pool);
+        setRoot(merge(root, other.root));
         other.root = nullptr;
     }
 
-    virtual void insert(T key) override {
-        root = merge(root, new SkewTree(key));
+    HeapHandle insert(T key) {
+        return emplace(std::move(key));
+    }
+
+    // the key is constructed in its node
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        SkewTree *tree = newTree(std::forward<Args>(args)...);
+        setRoot(merge(root, tree));
+        return HeapHandle(tree);
+    }
+
+    // extractMin that moves the key out
+    T pop() {
+        assert(root != nullptr);
+        T key = std::move(root->key);
+        extractMin();
+        return key;
     }
 
-    virtual void extractMin() override {
+    void extractMin() {
         assert(root != nullptr);
         SkewTree *oldRoot = root;
-        root = merge(root->left, root->right);
-        delete oldRoot;
+        setRoot(merge(root->left, root->right));
+        deleteNode(oldRoot);
+    }
+
+    // An O(1) cut of the element's subtree, then a merge back into the root.
+    // The cut can upset the balance that the amortized O(log n) of merge is
+    // paid from, so no overall bound is claimed.
+    void decreaseKey(HeapHandle handle, T newKey) {
+        SkewTree *tree = handle.as<SkewTree>();
+        assert(!less(tree->key, newKey));
+        tree->key = std::move(newKey);
+        if (tree->parent == nullptr || !less(tree->key, tree->parent->key))
+            return;
+        detach(tree);
+        setRoot(merge(root, tree));
+    }
+
+    void erase(HeapHandle handle) {
+        SkewTree *tree = handle.as<SkewTree>();
+        detach(tree);
+        SkewTree *children = merge(tree->left, tree->right);
+        if (children != nullptr)
+            children->parent = nullptr;
+        setRoot(merge(root, children));
+        deleteNode(tree);
     }
 
     bool empty() const {
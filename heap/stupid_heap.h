@@ -1,30 +1,47 @@
+#include <functional>
 #include <set>
 #include <iterator>
 
 #include "heap.h"
 
-template <typename T>
-class StupidHeap : public IHeap<T> {
+template <typename T, typename Compare = std::less<T>>
+class StupidHeap {
 private:
-    std::multiset<T> data;
+    std::multiset<T, Compare> data;
 
 public:
-    StupidHeap(): data() {}
+    typedef T value_type;
+    typedef Compare value_compare;
 
-    virtual void insert(T val) override {
-        data.insert(val);
+    explicit StupidHeap(const Compare &less = Compare()): data(less) {}
+
+    template <typename InputIt>
+    StupidHeap(InputIt first, InputIt last, const Compare &less = Compare()): data(first, last, less) {}
+
+    HeapHandle insert(T val) {
+        data.insert(std::move(val));
+        return HeapHandle();
     }
 
-    virtual T getMin() const override {
+    template <typename... Args>
+    HeapHandle emplace(Args&&... args) {
+        data.emplace(std::forward<Args>(args)...);
+        return HeapHandle();
+    }
+
+    const T& getMin() const {
         return *(data.begin());
     }
 
-    virtual void extractMin() override {
+    void extractMin() {
         data.erase(data.begin());
     }
 
-    virtual void meld(IHeap<T> &&other) override {
-        meld(dynamic_cast<StupidHeap&&>(other));
+    // a copy: the keys of a multiset are const
+    T pop() {
+        T val = *data.begin();
+        data.erase(data.begin());
+        return val;
     }
 
     void meld(StupidHeap&& other) {
@@ -36,7 +53,7 @@ public:
         other.data.clear();
     }
 
-    virtual bool empty() const override {
+    bool empty() const {
         return data.empty();
     }
 };
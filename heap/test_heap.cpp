@@ -2,14 +2,33 @@
 #include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <limits>
 
 #include <gtest/gtest.h>
 
+#include <dirent.h>
+
 #include "heap.h"
 #include "stupid_heap.h"
 #include "binomial_heap.h"
+#include "lazy_binomial_heap.h"
 #include "leftist_heap.h"
 #include "skew_heap.h"
+#include "dary_heap.h"
+#include "pairing_heap.h"
+#include "fibonacci_heap.h"
+#include "multi_queue.h"
+#include "persistent_leftist_heap.h"
+#include "persistent_skew_heap.h"
+#include "radix_heap.h"
+#include "external_heap.h"
+#include "loser_tree.h"
+#include "heap_forest.h"
 
 
 template <typename T, typename HeapT>
@@ -19,7 +38,7 @@ private:
 
 public:    
     void addHeap(T key) {
-        heaps.push_back(std::unique_ptr<IHeap<T>>(new HeapT()));
+        heaps.push_back(std::unique_ptr<IHeap<T>>(new HeapAdapter<HeapT>()));
         heaps.back()->insert(key);
     }
 
@@ -109,11 +128,70 @@ void TestCompareHeaps(size_t iterations) {
     }
 }
 
+// TestCompareHeaps for monotone heaps: a key inserted is never less than
+// the latest minimum its heap returned, and a meld keeps the lesser bound.
+template <typename HeapA, typename HeapB>
+void TestCompareMonotoneHeaps(size_t iterations) {
+    typedef typename HeapA::value_type T;
+    const size_t ops_cnt = 5;
+
+    HeapCollection<T, HeapA> heapsA;
+    HeapCollection<T, HeapB> heapsB;
+    std::vector<T> floors;
+    for (size_t iter = 0; iter < iterations; iter++) {
+        ASSERT_EQ(heapsA.size(), heapsB.size());
+
+        // no wrapping around for narrow keys
+        T delay = rand() % 100;
+        auto later = [delay](T floor) {
+            return static_cast<T>(floor + std::min<T>(delay, std::numeric_limits<T>::max() - floor));
+        };
+        Op op = static_cast<Op>(rand() % ops_cnt);
+        if (heapsA.empty() || op == ADD_HEAP) {
+            T key = later(floors.empty() ? 0 : floors[rand() % floors.size()]);
+            heapsA.addHeap(key);
+            heapsB.addHeap(key);
+            floors.push_back(0);
+            continue;
+        }
+
+        size_t index1 = rand() % heapsA.size();
+        size_t index2 = rand() % heapsA.size();
+        if (op == INSERT) {
+            heapsA.insert(index1, later(floors[index1]));
+            heapsB.insert(index1, later(floors[index1]));
+        } else if (op == GET_MIN) {
+            T m1 = heapsA.getMin(index1);
+            T m2 = heapsB.getMin(index1);
+            ASSERT_EQ(m1, m2);
+            floors[index1] = m1;
+        } else if (op == EXTRACT) {
+            ASSERT_EQ(heapsA.getMin(index1), heapsB.getMin(index1));
+            floors[index1] = heapsA.getMin(index1);
+            heapsA.extractMin(index1);
+            heapsB.extractMin(index1);
+            if (heapsA.size() < floors.size())
+                floors.erase(floors.begin() + index1);
+        } else {
+            heapsA.meld(index1, index2);
+            heapsB.meld(index1, index2);
+            if (index1 != index2) {
+                floors[index1] = std::min(floors[index1], floors[index2]);
+                floors.erase(floors.begin() + index2);
+            }
+        }
+    }
+}
+
 
 TEST(Heap, BinomialHeap) {
     TestCompareHeaps<StupidHeap<int>, BinomialHeap<int>>(10000);
 }
 
+TEST(Heap, LazyBinomialHeap) {
+    TestCompareHeaps<StupidHeap<int>, LazyBinomialHeap<int>>(10000);
+}
+
 TEST(Heap, LeftistHeap) {
     TestCompareHeaps<StupidHeap<int>, LeftistHeap<int>>(10000);
 }
@@ -122,6 +200,799 @@ TEST(Heap, SwekHeap) {
     TestCompareHeaps<StupidHeap<int>, SkewHeap<int>>(10000);
 }
 
+TEST(Heap, DaryHeap) {
+    TestCompareHeaps<StupidHeap<int>, DaryHeap<int, 2>>(10000);
+    TestCompareHeaps<StupidHeap<int>, DaryHeap<int>>(10000);
+    TestCompareHeaps<StupidHeap<int>, DaryHeap<int, 5>>(10000);
+    TestCompareHeaps<StupidHeap<int>, DaryHeap<int, 16>>(10000);
+}
+
+TEST(Heap, PairingHeap) {
+    TestCompareHeaps<StupidHeap<int>, PairingHeap<int>>(10000);
+}
+
+TEST(Heap, FibonacciHeap) {
+    TestCompareHeaps<StupidHeap<int>, FibonacciHeap<int>>(10000);
+}
+
+TEST(Heap, RadixHeap) {
+    TestCompareMonotoneHeaps<StupidHeap<unsigned>, RadixHeap<unsigned>>(10000);
+    TestCompareMonotoneHeaps<StupidHeap<unsigned long long>, RadixHeap<unsigned long long>>(10000);
+    TestCompareMonotoneHeaps<StupidHeap<unsigned char>, RadixHeap<unsigned char>>(1000);
+}
+
+// An event queue: values ride along with their keys, ties in any order.
+TEST(Heap, RadixHeapValues) {
+    RadixHeap<unsigned long long, int> events;
+    std::multiset<std::pair<unsigned long long, int>> expected;
+    unsigned long long now = 0;
+    for (int i = 0; i < 100000; i++) {
+        if (events.empty() || rand() % 3 != 0) {
+            unsigned long long time = now + rand() % (i % 2 ? 10 : 1000000);
+            events.emplace(time, i);
+            expected.insert(std::make_pair(time, i));
+            continue;
+        }
+        std::pair<unsigned long long, int> event = events.pop();
+        ASSERT_EQ(event.first, expected.begin()->first);
+        ASSERT_EQ(expected.erase(event), 1u);
+        now = event.first;
+    }
+    ASSERT_EQ(events.size(), expected.size());
+}
+
+
+// A few heaps under insert / extractMin / decreaseKey / erase / meld,
+// checked against a map of key -> handle per heap. Keys are unique, so the
+// extracted element is known.
+template <typename HeapT>
+void TestAddressableHeap(size_t iterations) {
+    const size_t heapsCnt = 4;
+    std::vector<HeapT> heaps(heapsCnt);
+    std::vector<std::map<long long, HeapHandle>> handles(heapsCnt);
+    std::set<long long> used;
+
+    auto freshKey = [&](long long below) {
+        long long key;
+        do {
+            key = rand() % below;
+        } while (!used.insert(key).second);
+        return key;
+    };
+
+    for (size_t iter = 0; iter < iterations; iter++) {
+        size_t index = rand() % heapsCnt;
+        HeapT &heap = heaps[index];
+        std::map<long long, HeapHandle> &live = handles[index];
+        ASSERT_EQ(heap.empty(), live.empty());
+
+        int op = rand() % 6;
+        if (live.empty() || op <= 1) {
+            long long key = freshKey(1000000);
+            live[key] = heap.insert(key);
+            continue;
+        }
+
+        ASSERT_EQ(heap.getMin(), live.begin()->first);
+        auto elem = std::next(live.begin(), rand() % live.size());
+        if (op == 2) {
+            heap.extractMin();
+            live.erase(live.begin());
+        } else if (op == 3 && elem->first > 0) {
+            long long key = freshKey(elem->first);
+            heap.decreaseKey(elem->second, key);
+            live[key] = elem->second;
+            live.erase(elem);
+        } else if (op == 4) {
+            heap.erase(elem->second);
+            live.erase(elem);
+        } else {
+            size_t other = rand() % heapsCnt;
+            heaps[other].meld(std::move(heap));
+            if (other != index) {
+                handles[other].insert(live.begin(), live.end());
+                live.clear();
+            }
+        }
+    }
+
+    // what is left comes out in order
+    for (size_t index = 0; index < heapsCnt; index++) {
+        for (auto elem : handles[index]) {
+            ASSERT_EQ(heaps[index].getMin(), elem.first);
+            heaps[index].extractMin();
+        }
+        ASSERT_TRUE(heaps[index].empty());
+    }
+}
+
+TEST(Heap, Addressable) {
+    TestAddressableHeap<LeftistHeap<long long>>(20000);
+    TestAddressableHeap<SkewHeap<long long>>(20000);
+    TestAddressableHeap<BinomialHeap<long long>>(20000);
+    TestAddressableHeap<LazyBinomialHeap<long long>>(20000);
+    TestAddressableHeap<PairingHeap<long long>>(20000);
+    TestAddressableHeap<FibonacciHeap<long long>>(20000);
+}
+
+template <typename HeapT>
+void TestNodePool() {
+    auto pool = std::make_shared<NodePool>();
+    {
+        HeapT a(pool), b(pool);
+        for (int i = 0; i < 1000; i++) {
+            a.insert(i);
+            b.insert(-i);
+        }
+        // popped nodes are reused, also across heaps of the pool
+        size_t footprint = pool->footprint();
+        for (int cycle = 0; cycle < 10; cycle++) {
+            for (int i = 0; i < 1000; i++) {
+                a.extractMin();
+                b.insert(i);
+            }
+            a.meld(std::move(b));
+            ASSERT_EQ(pool->footprint(), footprint);
+        }
+    }
+
+    // heaps on different pools, the emptied one goes first
+    std::unique_ptr<HeapT> c(new HeapT()), d(new HeapT());
+    for (int i = 0; i < 1000; i++) {
+        c->insert(2 * i);
+        d->insert(2 * i + 1);
+    }
+    c->meld(std::move(*d));
+    d.reset();
+    for (int i = 0; i < 1000; i++)
+        c->insert(2000 + i);
+    for (int i = 0; i < 3000; i++) {
+        ASSERT_EQ(c->getMin(), i);
+        c->extractMin();
+    }
+}
+
+TEST(Heap, NodePool) {
+    TestNodePool<LeftistHeap<int>>();
+    TestNodePool<SkewHeap<int>>();
+    TestNodePool<BinomialHeap<int>>();
+    TestNodePool<LazyBinomialHeap<int>>();
+}
+
+TEST(Heap, NodePoolNonTrivialKeys) {
+    SkewHeap<std::string> skew;
+    LeftistHeap<std::string> leftist;
+    BinomialHeap<std::string> binomial;
+    LazyBinomialHeap<std::string> lazyBinomial;
+    for (int i = 0; i < 1000; i++) {
+        skew.insert(std::string(100, 'a' + i % 26));
+        leftist.insert(std::string(100, 'a' + i % 26));
+        binomial.insert(std::string(100, 'a' + i % 26));
+        lazyBinomial.insert(std::string(100, 'a' + i % 26));
+    }
+    lazyBinomial.extractMin();
+    ASSERT_EQ(skew.getMin(), std::string(100, 'a'));
+    ASSERT_EQ(leftist.getMin(), std::string(100, 'a'));
+    ASSERT_EQ(binomial.getMin(), std::string(100, 'a'));
+    ASSERT_EQ(lazyBinomial.getMin(), std::string(100, 'a'));
+}
+
+// nodes above the size classes of the pool
+struct LargeKey {
+    int key;
+    char payload[500];
+
+    LargeKey(int key): key(key), payload() {}
+    bool operator<(const LargeKey &other) const {return key < other.key;}
+};
+
+template <typename HeapT>
+void TestLargeNodes() {
+    std::unique_ptr<HeapT> a(new HeapT()), b(new HeapT());
+    for (int i = 0; i < 1000; i++)
+        (i % 2 ? a : b)->insert(LargeKey(i));
+    a->meld(std::move(*b));
+    b.reset();
+    for (int i = 0; i < 500; i++) {
+        ASSERT_EQ(a->getMin().key, i);
+        a->extractMin();
+    }
+}
+
+TEST(Heap, NodePoolLargeNodes) {
+    TestLargeNodes<LeftistHeap<LargeKey>>();
+    TestLargeNodes<SkewHeap<LargeKey>>();
+    TestLargeNodes<BinomialHeap<LargeKey>>();
+    TestLargeNodes<LazyBinomialHeap<LargeKey>>();
+}
+
+template <typename HeapT>
+void TestBulkBuild(size_t size) {
+    std::vector<int> keys(size);
+    for (int &key : keys)
+        key = rand() % 1000;
+    HeapT heap(keys.begin(), keys.end());
+    std::sort(keys.begin(), keys.end());
+    for (int key : keys) {
+        ASSERT_EQ(heap.getMin(), key);
+        heap.extractMin();
+    }
+    ASSERT_TRUE(heap.empty());
+}
+
+TEST(Heap, BulkBuild) {
+    for (size_t size : {0, 1, 2, 3, 7, 64, 1000, 12345}) {
+        TestBulkBuild<StupidHeap<int>>(size);
+        TestBulkBuild<BinomialHeap<int>>(size);
+        TestBulkBuild<LazyBinomialHeap<int>>(size);
+        TestBulkBuild<LeftistHeap<int>>(size);
+        TestBulkBuild<SkewHeap<int>>(size);
+        TestBulkBuild<DaryHeap<int, 4>>(size);
+        TestBulkBuild<PairingHeap<int>>(size);
+        TestBulkBuild<FibonacciHeap<int>>(size);
+    }
+}
+
+// Sorted inserts leave chains of all the nodes, which neither merge nor
+// the teardown may recurse along.
+template <typename HeapT>
+void TestLongChains() {
+    const int size = 10 * 1000 * 1000;
+    std::vector<int> ascending(size);
+    for (int i = 0; i < size; i++)
+        ascending[i] = i;
+
+    auto pool = std::make_shared<NodePool>();
+    HeapT keep(pool); // so that the teardown walks the nodes
+    HeapT heap(pool);
+    for (int i = size; i-- > 0; )
+        heap.insert(i);
+    heap.meld(HeapT(ascending.begin(), ascending.end(), pool));
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(heap.getMin(), i / 2);
+        heap.extractMin();
+    }
+    for (int i = size; i-- > size - 1000; )
+        heap.insert(i);
+    ASSERT_EQ(heap.getMin(), 500);
+}
+
+TEST(Heap, LongChains) {
+    TestLongChains<LeftistHeap<int>>();
+    TestLongChains<SkewHeap<int>>();
+}
+
+struct DerefLess {
+    bool operator()(const std::unique_ptr<int> &a, const std::unique_ptr<int> &b) const {return *a < *b;}
+};
+
+// move-only keys under a custom order
+template <typename HeapT>
+void TestMoveOnlyKeys() {
+    std::vector<int> keys;
+    HeapT a, b;
+    for (int i = 0; i < 1000; i++) {
+        keys.push_back(rand() % 100);
+        if (i % 2)
+            a.insert(std::unique_ptr<int>(new int(keys.back())));
+        else
+            b.emplace(new int(keys.back()));
+    }
+    a.meld(std::move(b));
+    std::sort(keys.begin(), keys.end());
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (i % 2) {
+            ASSERT_EQ(*a.getMin(), keys[i]);
+            a.extractMin();
+        } else {
+            std::unique_ptr<int> key = a.pop();
+            ASSERT_EQ(*key, keys[i]);
+        }
+    }
+    ASSERT_TRUE(a.empty());
+}
+
+TEST(Heap, MoveOnlyKeys) {
+    TestMoveOnlyKeys<BinomialHeap<std::unique_ptr<int>, DerefLess>>();
+    TestMoveOnlyKeys<LazyBinomialHeap<std::unique_ptr<int>, DerefLess>>();
+    TestMoveOnlyKeys<LeftistHeap<std::unique_ptr<int>, DerefLess>>();
+    TestMoveOnlyKeys<SkewHeap<std::unique_ptr<int>, DerefLess>>();
+    TestMoveOnlyKeys<DaryHeap<std::unique_ptr<int>, 4, DerefLess>>();
+    TestMoveOnlyKeys<PairingHeap<std::unique_ptr<int>, DerefLess>>();
+    TestMoveOnlyKeys<FibonacciHeap<std::unique_ptr<int>, DerefLess>>();
+}
+
+// Counts its copies; ordered by priority alone.
+struct Task {
+    static size_t copies;
+    int priority;
+    char payload[60];
+
+    explicit Task(int priority): priority(priority), payload() {}
+    Task(const Task &other): priority(other.priority) {
+        std::copy(other.payload, other.payload + sizeof(payload), payload);
+        copies++;
+    }
+    Task(Task&&) = default;
+    Task& operator=(const Task &other) {
+        priority = other.priority;
+        std::copy(other.payload, other.payload + sizeof(payload), payload);
+        copies++;
+        return *this;
+    }
+    Task& operator=(Task&&) = default;
+};
+size_t Task::copies = 0;
+
+struct ByPriority {
+    bool operator()(const Task &a, const Task &b) const {return a.priority < b.priority;}
+};
+
+// emplace, meld and pop never copy a key
+template <typename HeapT>
+void TestNoCopies() {
+    Task::copies = 0;
+    HeapT a, b;
+    for (int i = 0; i < 1000; i++)
+        (i % 2 ? a : b).emplace(rand() % 100);
+    a.meld(std::move(b));
+    int last = -1;
+    while (!a.empty()) {
+        Task task = a.pop();
+        ASSERT_LE(last, task.priority);
+        last = task.priority;
+    }
+    ASSERT_EQ(Task::copies, 0u);
+}
+
+TEST(Heap, NoCopies) {
+    TestNoCopies<BinomialHeap<Task, ByPriority>>();
+    TestNoCopies<LazyBinomialHeap<Task, ByPriority>>();
+    TestNoCopies<LeftistHeap<Task, ByPriority>>();
+    TestNoCopies<SkewHeap<Task, ByPriority>>();
+    TestNoCopies<DaryHeap<Task, 4, ByPriority>>();
+    TestNoCopies<PairingHeap<Task, ByPriority>>();
+    TestNoCopies<FibonacciHeap<Task, ByPriority>>();
+}
+
+TEST(Heap, GreaterCompare) {
+    TestCompareHeaps<StupidHeap<int, std::greater<int>>, BinomialHeap<int, std::greater<int>>>(2000);
+    TestCompareHeaps<StupidHeap<int, std::greater<int>>, LazyBinomialHeap<int, std::greater<int>>>(2000);
+    TestCompareHeaps<StupidHeap<int, std::greater<int>>, LeftistHeap<int, std::greater<int>>>(2000);
+    TestCompareHeaps<StupidHeap<int, std::greater<int>>, SkewHeap<int, std::greater<int>>>(2000);
+    TestCompareHeaps<StupidHeap<int, std::greater<int>>, DaryHeap<int, 4, std::greater<int>>>(2000);
+    TestCompareHeaps<StupidHeap<int, std::greater<int>>, PairingHeap<int, std::greater<int>>>(2000);
+    TestCompareHeaps<StupidHeap<int, std::greater<int>>, FibonacciHeap<int, std::greater<int>>>(2000);
+}
+
+// heaps of different types meld by moving the keys over
+TEST(Heap, HeterogeneousMeld) {
+    std::unique_ptr<IHeap<int>> a(new HeapAdapter<LeftistHeap<int>>());
+    std::unique_ptr<IHeap<int>> b(new HeapAdapter<DaryHeap<int>>());
+    std::unique_ptr<IHeap<int>> c(new AddressableHeapAdapter<PairingHeap<int>>());
+    for (int i = 0; i < 300; i++)
+        (i % 3 == 0 ? a : i % 3 == 1 ? b : c)->insert(i);
+    a->meld(std::move(*b));
+    a->meld(std::move(*c));
+    ASSERT_TRUE(b->empty() && c->empty());
+
+    FibonacciHeap<int> d;
+    meld(d, std::move(static_cast<HeapAdapter<LeftistHeap<int>>&>(*a).get()));
+    for (int i = 0; i < 300; i++) {
+        ASSERT_EQ(d.getMin(), i);
+        d.extractMin();
+    }
+    ASSERT_TRUE(a->empty());
+}
+
+// Threads insert their own keys and pop concurrently, then the rest is
+// drained: every key comes out exactly once.
+template <typename HeapT>
+void TestMultiQueue(size_t threadCount, size_t shards) {
+    const int perThread = 20000;
+    MultiQueue<HeapT> queue(shards);
+    std::vector<std::vector<int>> popped(threadCount);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < threadCount; t++) {
+        threads.emplace_back([&queue, &popped, t]() {
+            for (int i = 0; i < perThread; i++) {
+                queue.insert(static_cast<int>(t) * perThread + i);
+                int key;
+                if (i % 3 == 0 && queue.tryPop(key))
+                    popped[t].push_back(key);
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    std::vector<int> all;
+    for (const std::vector<int> &keys : popped)
+        all.insert(all.end(), keys.begin(), keys.end());
+    ASSERT_EQ(queue.size() + all.size(), threadCount * perThread);
+    int key;
+    while (queue.tryPop(key))
+        all.push_back(key);
+    ASSERT_TRUE(queue.empty());
+    std::sort(all.begin(), all.end());
+    ASSERT_EQ(all.size(), threadCount * perThread);
+    for (size_t i = 0; i < all.size(); i++)
+        ASSERT_EQ(all[i], static_cast<int>(i));
+}
+
+// Mean rank of the popped keys among those in the queue, 0 being exact.
+template <typename HeapT>
+double MultiQueueRankError(size_t shards, int size, int pops) {
+    MultiQueue<HeapT> queue(shards);
+    std::vector<int> keys(size);
+    for (int i = 0; i < size; i++)
+        keys[i] = i;
+    std::random_shuffle(keys.begin(), keys.end());
+    for (int key : keys)
+        queue.insert(key);
+
+    std::set<int> present(keys.begin(), keys.end());
+    double rankSum = 0;
+    for (int i = 0; i < pops; i++) {
+        int key;
+        EXPECT_TRUE(queue.tryPop(key));
+        std::set<int>::iterator it = present.find(key);
+        rankSum += std::distance(present.begin(), it);
+        present.erase(it);
+    }
+    return rankSum / pops;
+}
+
+TEST(Heap, MultiQueue) {
+    TestMultiQueue<LeftistHeap<int>>(4, 8);
+    TestMultiQueue<DaryHeap<int>>(8, 16);
+    TestMultiQueue<PairingHeap<int>>(3, 1);
+
+    ASSERT_EQ(MultiQueueRankError<DaryHeap<int>>(1, 10000, 2000), 0.0);
+    // a few times the number of shards for two-choice pops
+    ASSERT_LT(MultiQueueRankError<DaryHeap<int>>(16, 10000, 2000), 4 * 16.0);
+}
+
+// A tree of versions, each derived from random earlier ones, checked
+// against a multiset per version: deriving a version changes no other.
+template <typename HeapT>
+void TestPersistentHeap(size_t iterations) {
+    std::vector<HeapT> versions(1);
+    typedef std::multiset<int, typename HeapT::value_compare> Keys;
+    std::vector<Keys> expected(1);
+    for (size_t iter = 0; iter < iterations; iter++) {
+        size_t from = rand() % versions.size();
+        size_t other = rand() % versions.size();
+        const HeapT &heap = versions[from];
+        Keys keys = expected[from];
+        int op = rand() % 4;
+        if (op == 0 && !heap.empty()) {
+            ASSERT_EQ(heap.getMin(), *keys.begin());
+            versions.push_back(heap.extractMin());
+            keys.erase(keys.begin());
+        } else if (op == 1 && keys.size() + expected[other].size() < 2000) {
+            versions.push_back(heap.meld(versions[other]));
+            keys.insert(expected[other].begin(), expected[other].end());
+        } else if (op == 2) {
+            versions.push_back(heap); // a snapshot
+        } else {
+            int key = rand() % 1000;
+            versions.push_back(heap.insert(key));
+            keys.insert(key);
+        }
+        expected.push_back(keys);
+        if (versions.size() > 200) {
+            // forget old versions, the nodes they share stay
+            versions.erase(versions.begin(), versions.begin() + 100);
+            expected.erase(expected.begin(), expected.begin() + 100);
+        }
+    }
+
+    for (size_t i = 0; i < versions.size(); i++) {
+        HeapT heap = versions[i];
+        ASSERT_EQ(heap.size(), expected[i].size());
+        for (int key : expected[i]) {
+            ASSERT_EQ(heap.getMin(), key);
+            heap = heap.extractMin();
+        }
+        ASSERT_TRUE(heap.empty());
+    }
+}
+
+TEST(Heap, PersistentHeap) {
+    TestPersistentHeap<PersistentLeftistHeap<int>>(5000);
+    TestPersistentHeap<PersistentSkewHeap<int>>(5000);
+    TestPersistentHeap<PersistentLeftistHeap<int, std::greater<int>>>(1000);
+}
+
+// A snapshot takes no memory, the first change of a big heap O(log n):
+// a thousand changed snapshots cost less than one deep copy.
+TEST(Heap, PersistentSnapshot) {
+    auto pool = std::make_shared<NodePool>();
+    PersistentLeftistHeap<int> heap(pool);
+    for (int i = 0; i < 100000; i++)
+        heap = heap.insert(rand());
+    size_t footprint = pool->footprint();
+    std::vector<PersistentLeftistHeap<int>> snapshots(1000, heap);
+    for (PersistentLeftistHeap<int> &snapshot : snapshots)
+        snapshot = snapshot.extractMin().insert(rand());
+    ASSERT_LT(pool->footprint() - footprint, footprint);
+    ASSERT_EQ(snapshots.back().size(), heap.size());
+}
+
+// descriptors open in this process, the run files of ExternalHeap among them
+size_t openFileCount() {
+    size_t count = 0;
+    if (DIR *dir = opendir("/proc/self/fd")) {
+        while (readdir(dir) != nullptr)
+            count++;
+        closedir(dir);
+    }
+    return count;
+}
+
+// Random insert / extractMin sequences of sampled lengths against
+// StupidHeap, on budgets small enough for many runs and level merges. The
+// heap is moved midway, and each run file is closed once drained.
+template <typename Compare>
+void TestExternalHeap(size_t memoryBytes, size_t iterations) {
+    const size_t openFiles = openFileCount();
+    ExternalHeap<int, Compare> source(memoryBytes);
+    StupidHeap<int, Compare> expected;
+    size_t prefix = rand() % iterations + 1;
+    for (size_t iter = 0; iter < prefix; iter++) {
+        ASSERT_EQ(source.empty(), expected.empty());
+        if (expected.empty() || rand() % 5 < 3) {
+            int key = rand() % 100000;
+            source.insert(key);
+            expected.insert(key);
+        } else {
+            ASSERT_EQ(source.getMin(), expected.getMin());
+            source.extractMin();
+            expected.extractMin();
+        }
+    }
+    ExternalHeap<int, Compare> heap(std::move(source));
+    ASSERT_TRUE(source.empty());
+    ASSERT_EQ(source.runCount(), 0u);
+    while (!expected.empty()) {
+        ASSERT_EQ(heap.pop(), expected.pop());
+    }
+    ASSERT_TRUE(heap.empty());
+    ASSERT_EQ(heap.runCount(), 0u);
+    ASSERT_EQ(openFileCount(), openFiles);
+}
+
+TEST(Heap, ExternalHeap) {
+    for (int sample = 0; sample < 20; sample++) {
+        TestExternalHeap<std::less<int>>(1024, 50000);
+        TestExternalHeap<std::greater<int>>(4096, 50000);
+    }
+    TestExternalHeap<std::less<int>>(static_cast<size_t>(1) << 20, 1000000);
+}
+
+// Sorted runs of (key, run) pairs merged by key: the loser tree must give
+// what a chain of stable std::merge calls gives, ties included.
+void TestLoserTree(size_t runsCnt, size_t maxLength) {
+    typedef std::pair<int, size_t> Tagged;
+    auto byKey = [](const Tagged &a, const Tagged &b) {return a.first < b.first;};
+
+    std::vector<std::vector<Tagged>> runs(runsCnt);
+    for (size_t i = 0; i < runsCnt; i++) {
+        runs[i].resize(rand() % (maxLength + 1));
+        for (Tagged &key : runs[i])
+            key = Tagged(rand() % 100, i);
+        std::sort(runs[i].begin(), runs[i].end(), byKey);
+    }
+
+    std::vector<Tagged> expected;
+    for (const std::vector<Tagged> &run : runs) {
+        std::vector<Tagged> merged;
+        std::merge(expected.begin(), expected.end(), run.begin(), run.end(), std::back_inserter(merged), byKey);
+        expected.swap(merged);
+    }
+
+    typedef std::vector<Tagged>::const_iterator It;
+    std::vector<std::pair<It, It>> ranges;
+    for (const std::vector<Tagged> &run : runs)
+        ranges.push_back(std::make_pair(run.cbegin(), run.cend()));
+    std::vector<Tagged> merged;
+    mergeRanges(ranges, std::back_inserter(merged), byKey);
+    ASSERT_EQ(merged, expected);
+}
+
+// A pull source with no container behind it.
+class MultiplesSource {
+private:
+    int step;
+    int left;
+    int current;
+
+public:
+    typedef int value_type;
+
+    MultiplesSource(int step, int count): step(step), left(count), current(0) {}
+
+    bool next(int &key) {
+        if (left == 0)
+            return false;
+        left--;
+        key = (current += step);
+        return true;
+    }
+};
+
+TEST(Heap, LoserTree) {
+    for (size_t runsCnt : {0, 1, 2, 3, 5, 8, 13, 64})
+        for (int sample = 0; sample < 10; sample++)
+            TestLoserTree(runsCnt, 200);
+    TestLoserTree(1000, 20); // the chain of merges is quadratic
+
+    // pulled in odd batches
+    std::vector<MultiplesSource> sources;
+    std::vector<int> expected;
+    for (int step = 1; step <= 7; step++) {
+        sources.push_back(MultiplesSource(step, 1000));
+        for (int i = 1; i <= 1000; i++)
+            expected.push_back(step * i);
+    }
+    std::sort(expected.begin(), expected.end());
+    LoserTree<MultiplesSource> tree(std::move(sources));
+    std::vector<int> merged;
+    int batch[37];
+    while (size_t count = tree.next(batch, 1 + rand() % 37))
+        merged.insert(merged.end(), batch, batch + count);
+    ASSERT_TRUE(tree.empty());
+    ASSERT_EQ(merged, expected);
+}
+
+// The TestCompareHeaps mix on a HeapForest, against StupidHeaps by
+// handle; handles of heaps melded away or removed must turn invalid.
+template <typename HeapT>
+void TestHeapForest(size_t iterations) {
+    HeapForest<HeapT> forest;
+    std::vector<typename HeapForest<HeapT>::Handle> handles;
+    std::vector<StupidHeap<int>> expected;
+    std::vector<typename HeapForest<HeapT>::Handle> stale;
+
+    auto remove = [&](size_t index) {
+        stale.push_back(handles[index]);
+        handles[index] = handles.back();
+        handles.pop_back();
+        expected[index] = std::move(expected.back());
+        expected.pop_back();
+    };
+
+    for (size_t iter = 0; iter < iterations; iter++) {
+        ASSERT_EQ(forest.size(), handles.size());
+        int key = 1 + rand() % 100;
+        int op = rand() % 6;
+        if (handles.empty() || op == 0) {
+            handles.push_back(forest.addHeap());
+            expected.push_back(StupidHeap<int>());
+            forest.insert(handles.back(), key);
+            expected.back().insert(key);
+            continue;
+        }
+
+        size_t index1 = rand() % handles.size();
+        size_t index2 = rand() % handles.size();
+        ASSERT_TRUE(forest.valid(handles[index1]));
+        if (op == 1) {
+            forest.insert(handles[index1], key);
+            expected[index1].insert(key);
+        } else if (op == 2) {
+            ASSERT_EQ(forest.getMin(handles[index1]), expected[index1].getMin());
+        } else if (op == 3) {
+            ASSERT_EQ(forest.pop(handles[index1]), expected[index1].pop());
+            if (forest.empty(handles[index1])) {
+                forest.removeHeap(handles[index1]);
+                remove(index1);
+            }
+        } else if (op == 4 && index1 != index2) {
+            forest.meld(handles[index1], handles[index2]);
+            expected[index1].meld(std::move(expected[index2]));
+            remove(index2);
+        } else if (op == 5 && rand() % 10 == 0) {
+            forest.removeHeap(handles[index1]);
+            remove(index1);
+        }
+    }
+
+    for (auto handle : stale)
+        ASSERT_FALSE(forest.valid(handle));
+    for (size_t i = 0; i < handles.size(); i++) {
+        while (!expected[i].empty())
+            ASSERT_EQ(forest.pop(handles[i]), expected[i].pop());
+        ASSERT_TRUE(forest.empty(handles[i]));
+    }
+}
+
+TEST(Heap, HeapForest) {
+    TestHeapForest<LeftistHeap<int>>(100000);
+    TestHeapForest<PairingHeap<int>>(100000);
+    TestHeapForest<DaryHeap<int>>(100000);
+    TestHeapForest<StupidHeap<int>>(10000);
+}
+
+// Elements found through melds by union-find, then changed through the
+// forest; keys are unique, so each heap's minimum is known.
+TEST(Heap, HeapForestOwners) {
+    typedef HeapForest<FibonacciHeap<long long>, true> Forest;
+    Forest forest;
+    std::vector<Forest::Handle> handles;
+    std::map<long long, std::pair<Forest::Element, Forest::Handle>> elements; // key -> element, heap
+    long long nextKey = 1000000;
+
+    for (size_t iter = 0; iter < 50000; iter++) {
+        int op = rand() % 5;
+        if (handles.empty() || op == 0) {
+            handles.push_back(forest.addHeap());
+            continue;
+        }
+        size_t index1 = rand() % handles.size();
+        size_t index2 = rand() % handles.size();
+        if (op == 1 || elements.empty()) {
+            long long key = nextKey++;
+            elements[key] = std::make_pair(forest.insert(handles[index1], key), handles[index1]);
+        } else if (op == 2 && index1 != index2) {
+            forest.meld(handles[index1], handles[index2]);
+            for (auto &elem : elements)
+                if (elem.second.second == handles[index2])
+                    elem.second.second = handles[index1];
+            handles[index2] = handles.back();
+            handles.pop_back();
+        } else {
+            auto elem = std::next(elements.begin(), rand() % elements.size());
+            ASSERT_EQ(forest.owner(elem->second.first), elem->second.second);
+            if (op == 3) {
+                long long key = elements.begin()->first - 1 - rand() % 10;
+                forest.decreaseKey(elem->second.first, key);
+                elements[key] = elem->second;
+                elements.erase(elem);
+            } else {
+                forest.erase(elem->second.first);
+                elements.erase(elem);
+            }
+        }
+    }
+
+    for (Forest::Handle handle : handles) {
+        std::vector<long long> keys;
+        for (auto &elem : elements)
+            if (elem.second.second == handle)
+                keys.push_back(elem.first);
+        for (long long key : keys) {
+            ASSERT_EQ(forest.owner(elements[key].first), handle);
+            ASSERT_EQ(forest.pop(handle), key);
+        }
+        ASSERT_TRUE(forest.empty(handle));
+    }
+}
+
+template <typename T, size_t D>
+void TestMinOfChildren() {
+    for (size_t iter = 0; iter < 1000; iter++) {
+        T keys[D];
+        for (size_t i = 0; i < D; i++)
+            keys[i] = static_cast<T>(rand() % 10) - static_cast<T>(iter % 2 ? 5 : 0);
+        for (size_t count = 1; count <= D; count++) {
+            size_t pos = MinOfChildren<T, D>::find(keys, count);
+            ASSERT_LT(pos, count);
+            ASSERT_EQ(keys[pos], *std::min_element(keys, keys + count));
+        }
+    }
+}
+
+TEST(Heap, MinOfChildren) {
+    TestMinOfChildren<int, 4>();
+    TestMinOfChildren<int, 16>();
+    TestMinOfChildren<unsigned, 8>();
+    TestMinOfChildren<float, 8>();
+    TestMinOfChildren<double, 3>();
+    TestMinOfChildren<long long, 6>();
+}
+
 
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);